@@ -0,0 +1,367 @@
+#include "Aggregator.h"
+#include "Trace.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+
+// A node whose sequence jumps further ahead than this, or falls further
+// behind than kMaxLateFrames, restarted; resynchronise instead of waiting
+// for the gap or dropping its frames as duplicates.
+static constexpr int64_t kMaxSequenceJump = 10000;
+static constexpr int64_t kMaxLateFrames = 64;
+
+// Upper bound of frames held per node while waiting for a gap to fill.
+static constexpr size_t kMaxPending = 256;
+
+bool WiimoAggregator::setup(int port, uint64_t reorderWindowMicros)
+{
+	mWindow = reorderWindowMicros;
+	mBuffer.resize(WiimoWire::MaxPacketSize);
+
+	if (mSocket.isOpen() && mSocket.port() == port)
+		return true;
+
+	bool r = mSocket.bind(port);
+	if (r)
+		ofLogNotice() << "Aggregator: listening on port " << port;
+	else
+		ofLogWarning() << "Aggregator: failed to listen on port " << port;
+	return r;
+}
+
+void WiimoAggregator::close()
+{
+	mSocket.close();
+}
+
+void WiimoAggregator::update()
+{
+	WIIMO_TRACE_ZONE("aggregator");
+
+	if (!mSocket.isOpen())
+		return;
+
+	WiimoWire::Frame frame;
+	int size;
+	while ((size = mSocket.receive(mBuffer.data(), mBuffer.size(), 0)) > 0) {
+		mStats.packets++;
+
+		if (!WiimoWire::decode(mBuffer.data(), static_cast<size_t>(size), frame)) {
+			mStats.rejected++;
+			continue;
+		}
+
+		receive(frame, Wiimote::Manager::timestampMicros());
+	}
+
+	release(Wiimote::Manager::timestampMicros());
+}
+
+void WiimoAggregator::receive(const WiimoWire::Frame& frame, uint64_t now)
+{
+	if (frame.node == 0) {
+		mStats.rejected++;
+		return;
+	}
+
+	Node& node = mNodes[frame.node];
+	mStats.nodes = mNodes.size();
+
+	node.clockOffset = std::min(node.clockOffset, static_cast<int64_t>(now) - static_cast<int64_t>(frame.timestamp));
+
+	// Unwrap the 32-bit sequence number around the one expected next.
+	int64_t diff = static_cast<int32_t>(frame.sequence - static_cast<uint32_t>(node.expected));
+	if (node.started && (diff > kMaxSequenceJump || diff < -kMaxLateFrames)) {
+		ofLogNotice() << "Aggregator: node " << frame.node << " restarted (sequence " << frame.sequence << ").";
+		mStats.restarts++;
+		node.pending.clear();
+		node.started = false;
+		node.clockOffset = static_cast<int64_t>(now) - static_cast<int64_t>(frame.timestamp);
+	}
+
+	if (!node.started) {
+		node.started = true;
+		node.expected = frame.sequence;
+		diff = 0;
+	}
+
+	const uint64_t sequence = node.expected + diff;
+	if (diff < 0 || node.pending.count(sequence)) {
+		mStats.duplicates++;
+		return;
+	}
+
+	if (!node.pending.empty() && node.pending.rbegin()->first > sequence)
+		mStats.reordered++;
+
+	Pending& p = node.pending[sequence];
+	p.arrival = now;
+	p.frame = frame;
+}
+
+void WiimoAggregator::release(uint64_t now)
+{
+	for (auto& [id, node] : mNodes) {
+		while (!node.pending.empty()) {
+			auto it = node.pending.begin();
+
+			if (it->first != node.expected) {
+				// A gap: wait for it to fill until the oldest held frame is due.
+				if (now - it->second.arrival < mWindow && node.pending.size() < kMaxPending)
+					break;
+
+				mStats.lost += it->first - node.expected;
+				node.expected = it->first;
+			}
+
+			emit(node, it->second.frame);
+			node.expected++;
+			node.pending.erase(it);
+		}
+	}
+}
+
+int WiimoAggregator::globalId(uint16_t node, uint8_t id)
+{
+	const uint32_t key = (static_cast<uint32_t>(node) << 8) | id;
+	if (auto it = mIds.find(key); it != mIds.end())
+		return it->second;
+
+	const int global = mAllocateId ? mAllocateId() : 1 + static_cast<int>(mIds.size());
+	if (global < 1 || global > static_cast<int>(WiimoWire::MaxControllers))
+		return 0;
+
+	ofLogNotice() << "Aggregator: node " << node << " controller " << int(id) << " -> id " << global;
+	mIds[key] = global;
+	return global;
+}
+
+void WiimoAggregator::emit(Node& node, WiimoWire::Frame& frame)
+{
+	const uint16_t source = frame.node;
+
+	size_t count = 0;
+	frame.presence = 0;
+	for (size_t i = 0; i < frame.count; ++i) {
+		WiimoWire::Controller c = frame.controllers[i];
+		int id = globalId(source, c.id);
+		if (!id) {
+			mStats.unmapped++;
+			continue;
+		}
+
+		c.id = static_cast<uint8_t>(id);
+		frame.presence |= uint32_t(1) << (id - 1);
+		frame.controllers[count++] = c;
+	}
+
+	std::sort(frame.controllers, frame.controllers + count, [](const auto& a, const auto& b) { return a.id < b.id; });
+
+	frame.count = count;
+	frame.node = 0;
+	frame.sequence = mSequence++;
+	frame.timestamp = static_cast<uint64_t>(static_cast<int64_t>(frame.timestamp) + node.clockOffset);
+	mStats.frames++;
+
+	if (mFrameCallback)
+		mFrameCallback(frame);
+
+	if (mCallback) {
+		for (size_t i = 0; i < frame.count; ++i)
+			mCallback(toEvents(frame.controllers[i]));
+	}
+}
+
+/*static*/ Wiimote::ControllerEvents WiimoAggregator::toEvents(const WiimoWire::Controller& c)
+{
+	Wiimote::ControllerEvents events;
+	events.id = c.id;
+
+	for (int b = Wiimote::MoteButtonBegin; b < Wiimote::MoteButtonEnd; ++b) {
+		const bool pressed = c.pressed & (1 << b);
+		const bool released = c.released & (1 << b);
+		events.moteButtonTransitions[b] = released ? Wiimote::TransitionReleased
+			: pressed ? Wiimote::TransitionPressed : Wiimote::TransitionNone;
+	}
+
+	// Both bits of a button: coalesced on the node. The order is lost; assume a click.
+	if (c.pressed & c.released) {
+		for (int b = Wiimote::MoteButtonBegin; b < Wiimote::MoteButtonEnd; ++b) {
+			if (c.pressed & (1 << b))
+				events.buttonEvents.push_back({ Wiimote::MoteButton(b), Wiimote::TransitionPressed });
+			if (c.released & (1 << b))
+				events.buttonEvents.push_back({ Wiimote::MoteButton(b), Wiimote::TransitionReleased });
+		}
+	}
+
+	if (c.fields & WiimoWire::FieldMote)
+		events.moteOrientation = Wiimote::Orientation{ c.mote[1], c.mote[0], c.mote[2] };
+	if (c.fields & WiimoWire::FieldChuck)
+		events.chuckOrientation = Wiimote::Orientation{ c.chuck[1], c.chuck[0], c.chuck[2] };
+	if (c.fields & WiimoWire::FieldJoystick)
+		events.chuckJoystick = Wiimote::Joystick{ c.joystick[0], c.joystick[1], c.joystick[2], c.joystick[3] };
+	if (c.fields & WiimoWire::FieldBoard)
+		events.balanceBoard = Wiimote::BalanceBoard{ c.board[0], c.board[1], c.board[2], c.board[3], c.board[4], c.board[5], c.board[6] };
+
+	return events;
+}
+
+//==============================================================================
+//
+// Loopback tools
+//
+//==============================================================================
+
+void runFakeNode(uint16_t node, const std::string& host, int port, int count, double rateHz, int seconds)
+{
+	using Clock = std::chrono::steady_clock;
+
+	Net::UdpSocket socket;
+	if (!socket.connect(host, port)) {
+		ofLogError() << "Fake node: cannot send to " << host << ":" << port;
+		return;
+	}
+
+	std::mt19937 rng(node);
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+	std::vector<uint8_t> buffer(WiimoWire::MaxPacketSize), held;
+	uint64_t sent = 0, dropped = 0, swapped = 0;
+
+	const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rateHz));
+	const auto start = Clock::now();
+	auto next = start;
+
+	for (uint32_t sequence = 0; Clock::now() - start < std::chrono::seconds(seconds); ++sequence) {
+		const double t = std::chrono::duration<double>(Clock::now() - start).count();
+
+		WiimoWire::Writer writer(buffer.data(), buffer.size());
+		writer.begin(node, sequence, Wiimote::Manager::timestampMicros());
+		for (int id = 1; id <= count; ++id) {
+			WiimoWire::Controller c;
+			c.id = static_cast<uint8_t>(id);
+			c.fields = WiimoWire::FieldMote;
+			c.mote[0] = static_cast<float>(45.0 * std::sin(t + id));
+			c.mote[1] = static_cast<float>(30.0 * std::cos(t + id));
+			if (sequence % 100 == 0)
+				c.pressed = 1 << Wiimote::MoteButton_A;
+			writer.add(c);
+		}
+		const size_t size = writer.finish();
+
+		// 1% lost, 2% delayed behind the next frame.
+		const double r = chance(rng);
+		if (r < 0.01) {
+			dropped++;
+		}
+		else if (r < 0.03 && held.empty()) {
+			held.assign(buffer.begin(), buffer.begin() + size);
+			swapped++;
+		}
+		else {
+			sent += socket.send(buffer.data(), size);
+			if (!held.empty()) {
+				sent += socket.send(held.data(), held.size());
+				held.clear();
+			}
+		}
+
+		next += period;
+		std::this_thread::sleep_until(next);
+	}
+
+	ofLogNotice() << "Fake node " << node << ": sent " << sent << " frames, dropped " << dropped << ", swapped " << swapped;
+}
+
+void runAggregator(int port, int seconds)
+{
+	WiimoAggregator aggregator;
+	if (!aggregator.setup(port))
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	auto report = start;
+
+	while (std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds)) {
+		aggregator.update();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		if (std::chrono::steady_clock::now() - report >= std::chrono::seconds(1)) {
+			report += std::chrono::seconds(1);
+			const AggregatorStats& s = aggregator.stats();
+			ofLogNotice() << "Aggregator: " << s.nodes << " nodes, " << s.packets << " packets, " << s.frames
+				<< " frames out, lost " << s.lost << ", reordered " << s.reordered << ", duplicates " << s.duplicates
+				<< ", rejected " << s.rejected << ", unmapped " << s.unmapped;
+		}
+	}
+}
+
+bool runAggregatorTest()
+{
+	struct Expected
+	{
+		uint64_t frames, lost, duplicates, restarts;
+	};
+
+	// One node's frames, sent as the sequence numbers given, 10 ms apart.
+	const auto run = [](const char* name, const std::vector<uint32_t>& sequences, const Expected& expected) {
+		WiimoAggregator aggregator;
+		uint64_t now = 1000000;
+		for (uint32_t sequence : sequences) {
+			WiimoWire::Frame frame;
+			frame.node = 1;
+			frame.sequence = sequence;
+			frame.timestamp = now;
+			frame.count = 1;
+			frame.presence = 1;
+			frame.controllers[0].id = 1;
+			frame.controllers[0].fields = WiimoWire::FieldMote;
+
+			aggregator.receive(frame, now);
+			aggregator.release(now);
+			now += 10000;
+		}
+		aggregator.release(now + 1000000);
+
+		const AggregatorStats& s = aggregator.stats();
+		if (s.frames == expected.frames && s.lost == expected.lost && s.duplicates == expected.duplicates && s.restarts == expected.restarts)
+			return true;
+
+		ofLogError() << "Aggregator test, " << name << ": " << s.frames << " frames (expected " << expected.frames << "), lost "
+			<< s.lost << " (" << expected.lost << "), duplicates " << s.duplicates << " (" << expected.duplicates << "), restarts "
+			<< s.restarts << " (" << expected.restarts << ")";
+		return false;
+	};
+
+	const auto count = [](uint32_t from, uint32_t to) {
+		std::vector<uint32_t> sequences;
+		for (uint32_t s = from; s < to; ++s)
+			sequences.push_back(s);
+		return sequences;
+	};
+	const auto join = [](std::vector<uint32_t> a, const std::vector<uint32_t>& b) {
+		a.insert(a.end(), b.begin(), b.end());
+		return a;
+	};
+
+	bool passed = true;
+
+	// A frame repeated, a gap given up after the reorder window, and a frame of it arriving after that.
+	passed &= run("late frames", join(count(0, 100), join({ 95, 103, 104, 105, 101 }, count(106, 200))), { 197, 3, 2, 0 });
+
+	// Restarts after 5 s and after 100 s of frames: the new frames all come through.
+	passed &= run("restart after 500 frames", join(count(0, 500), count(0, 300)), { 800, 0, 0, 1 });
+	passed &= run("restart after 10000 frames", join(count(0, 10000), count(0, 300)), { 10300, 0, 0, 1 });
+
+	// Sequence wrap-around is not a restart.
+	passed &= run("wrap-around", join(count(0xFFFFFF00u, 0xFFFFFFFFu), join({ 0xFFFFFFFFu }, count(0, 100))), { 356, 0, 0, 0 });
+
+	if (passed)
+		ofLogNotice() << "Aggregator test passed.";
+	return passed;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "WiimoteManager.h"
+#include "WiimoWire.h"
+#include "Socket.h"
+
+struct AggregatorStats
+{
+	uint64_t packets = 0;    // Datagrams received.
+	uint64_t frames = 0;     // Frames emitted, in order.
+	uint64_t lost = 0;       // Sequence numbers never received within the window.
+	uint64_t reordered = 0;  // Frames that arrived after a later one.
+	uint64_t duplicates = 0; // Frames received twice, or after their slot was given up.
+	uint64_t restarts = 0;   // Nodes that started over with a distant sequence number.
+	uint64_t rejected = 0;   // Malformed packets, or from node 0 (standalone).
+	uint64_t unmapped = 0;   // Controllers dropped because all global ids are taken.
+	size_t nodes = 0;
+};
+
+/**
+ *	Combines the binary frames of several wiimo nodes into one stream.
+ *
+ *	Each node runs the binary output with its own node id (1..65535),
+ *	pointed at the aggregator's port. The aggregator
+ *	  - maps every (node, controller id) to a global controller id, in
+ *	    the order they first appear, taken from the id allocator (in the
+ *	    app Manager::claimId(), so they never collide with local ids);
+ *	  - releases the frames of each node in sequence order, holding early
+ *	    ones for up to the reorder window while a gap may still fill;
+ *	  - counts the sequence numbers it gave up on as lost;
+ *	  - converts node timestamps to the local clock with a per-node offset
+ *	    (the smallest arrival - send time seen, i.e. the fastest path);
+ *	and hands the result to the callbacks, to be re-emitted through the
+ *	normal outputs. Frames from node 0 are rejected, so an aggregator's own
+ *	output cannot loop back into it.
+ */
+class WiimoAggregator
+{
+public:
+	bool setup(int port, uint64_t reorderWindowMicros = 20000);
+	void close();
+	bool isReady() const { return mSocket.isOpen(); }
+
+	// Receives pending datagrams and emits every frame that is due.
+	void update();
+
+	// Source of global ids, 0 when none is left; without one, ids count up from 1.
+	void setIdAllocator(std::function<int()> allocate) { mAllocateId = allocate; }
+
+	// Called for every controller of an emitted frame, with its global id.
+	void onControllerEvents(std::function<void(const Wiimote::ControllerEvents&)> callback) { mCallback = callback; }
+
+	// Called for every emitted frame (global ids, aggregator sequence, local timestamp).
+	// The binary and shared-memory outputs renumber it in their own sequence.
+	void onFrame(std::function<void(const WiimoWire::Frame&)> callback) { mFrameCallback = callback; }
+
+	const AggregatorStats& stats() const { return mStats; }
+
+	static Wiimote::ControllerEvents toEvents(const WiimoWire::Controller& c);
+
+	// Received frames are processed as if they arrived at now; used by update() and tests.
+	void receive(const WiimoWire::Frame& frame, uint64_t now);
+	void release(uint64_t now);
+
+private:
+	struct Pending
+	{
+		uint64_t arrival = 0;
+		WiimoWire::Frame frame;
+	};
+
+	struct Node
+	{
+		bool started = false;
+		uint64_t expected = 0;             // Next sequence number to release, unwrapped.
+		int64_t clockOffset = INT64_MAX;   // Local minus node clock, microseconds.
+		std::map<uint64_t, Pending> pending;
+	};
+
+	void emit(Node& node, WiimoWire::Frame& frame);
+	int globalId(uint16_t node, uint8_t id);
+
+	Net::UdpSocket mSocket;
+	std::vector<uint8_t> mBuffer;
+
+	std::function<int()> mAllocateId;
+	uint64_t mWindow = 20000;
+	uint32_t mSequence = 0;
+
+	std::map<uint16_t, Node> mNodes;
+	std::map<uint32_t, int> mIds; // (node << 8 | id) -> global id
+
+	std::function<void(const Wiimote::ControllerEvents&)> mCallback;
+	std::function<void(const WiimoWire::Frame&)> mFrameCallback;
+
+	AggregatorStats mStats;
+};
+
+// Sends synthetic frames from node with count controllers to host:port at
+// rateHz, dropping and swapping a few on purpose, for loopback tests of
+// the aggregator with several processes.
+void runFakeNode(uint16_t node, const std::string& host, int port, int count, double rateHz, int seconds);
+
+// Runs an aggregator without the app and logs its statistics every second.
+void runAggregator(int port, int seconds);
+
+// Feeds an aggregator scripted sequences (late duplicates, a node restarting
+// after a few frames and after a long run) and checks what it emits.
+// Returns false on a mismatch.
+bool runAggregatorTest();
@@ -0,0 +1,422 @@
+#include "Alignment.h"
+#include "WiimoteManager.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace Wiimote
+{
+
+static_assert(Aligner::MaxControllers == MAX_WIIMOTES, "One aligner slot per wiimote slot.");
+
+namespace
+{
+	// Channel groups of a sample: one per optional stream of ControllerEvents.
+	enum Group
+	{
+		GroupMote = 1 << 0,
+		GroupChuck = 1 << 1,
+		GroupJoystick = 1 << 2,
+		GroupBoard = 1 << 3,
+		GroupPredictedMote = 1 << 4,
+		GroupPredictedChuck = 1 << 5,
+		GroupPredictedJoystick = 1 << 6,
+
+		GroupCount = 7
+	};
+
+	struct GroupRange
+	{
+		int begin;
+		int end;
+		uint32_t wrap; // Channels (relative to begin) holding angles in degrees.
+	};
+
+	constexpr GroupRange kGroups[GroupCount] = {
+		{ 0, 3, 0b111 },   // mote roll, pitch, yaw
+		{ 3, 6, 0b111 },   // chuck roll, pitch, yaw
+		{ 6, 10, 0b0001 }, // joystick angle, magnitude, x, y
+		{ 10, 17, 0 },     // board x, y, total, tr, tl, br, bl
+		{ 17, 20, 0b111 },
+		{ 20, 23, 0b111 },
+		{ 23, 27, 0b0001 },
+	};
+
+	static_assert(kGroups[GroupCount - 1].end == Aligner::Channels, "Channel groups must cover all channels.");
+
+	void putOrientation(const Orientation& o, float* v)
+	{
+		v[0] = o.roll;
+		v[1] = o.pitch;
+		v[2] = o.yaw;
+	}
+
+	void putJoystick(const Joystick& j, float* v)
+	{
+		v[0] = j.angle;
+		v[1] = j.magni;
+		v[2] = j.x;
+		v[3] = j.y;
+	}
+
+	Orientation getOrientation(const float* v)
+	{
+		Orientation o;
+		o.roll = v[0];
+		o.pitch = v[1];
+		o.yaw = v[2];
+		return o;
+	}
+
+	Joystick getJoystick(const float* v)
+	{
+		return Joystick{ v[0], v[1], v[2], v[3] };
+	}
+
+	uint32_t gather(const ControllerEvents& e, float* v)
+	{
+		uint32_t groups = 0;
+		if (e.moteOrientation) {
+			putOrientation(*e.moteOrientation, v + kGroups[0].begin);
+			groups |= GroupMote;
+		}
+		if (e.chuckOrientation) {
+			putOrientation(*e.chuckOrientation, v + kGroups[1].begin);
+			groups |= GroupChuck;
+		}
+		if (e.chuckJoystick) {
+			putJoystick(*e.chuckJoystick, v + kGroups[2].begin);
+			groups |= GroupJoystick;
+		}
+		if (e.balanceBoard) {
+			const BalanceBoard& b = *e.balanceBoard;
+			float* p = v + kGroups[3].begin;
+			p[0] = b.x; p[1] = b.y; p[2] = b.total;
+			p[3] = b.tr; p[4] = b.tl; p[5] = b.br; p[6] = b.bl;
+			groups |= GroupBoard;
+		}
+		if (e.predictedMoteOrientation) {
+			putOrientation(*e.predictedMoteOrientation, v + kGroups[4].begin);
+			groups |= GroupPredictedMote;
+		}
+		if (e.predictedChuckOrientation) {
+			putOrientation(*e.predictedChuckOrientation, v + kGroups[5].begin);
+			groups |= GroupPredictedChuck;
+		}
+		if (e.predictedChuckJoystick) {
+			putJoystick(*e.predictedChuckJoystick, v + kGroups[6].begin);
+			groups |= GroupPredictedJoystick;
+		}
+		return groups;
+	}
+
+	void scatter(uint32_t groups, const float* v, ControllerEvents& e)
+	{
+		if (groups & GroupMote)
+			e.moteOrientation = getOrientation(v + kGroups[0].begin);
+		if (groups & GroupChuck)
+			e.chuckOrientation = getOrientation(v + kGroups[1].begin);
+		if (groups & GroupJoystick)
+			e.chuckJoystick = getJoystick(v + kGroups[2].begin);
+		if (groups & GroupBoard) {
+			const float* p = v + kGroups[3].begin;
+			e.balanceBoard = BalanceBoard{ p[0], p[1], p[2], p[3], p[4], p[5], p[6] };
+		}
+		if (groups & GroupPredictedMote)
+			e.predictedMoteOrientation = getOrientation(v + kGroups[4].begin);
+		if (groups & GroupPredictedChuck)
+			e.predictedChuckOrientation = getOrientation(v + kGroups[5].begin);
+		if (groups & GroupPredictedJoystick)
+			e.predictedChuckJoystick = getJoystick(v + kGroups[6].begin);
+	}
+}
+
+void Aligner::configure(const AlignmentConfig& config)
+{
+	mPeriod = std::max<uint64_t>(1000, static_cast<uint64_t>(std::llround(1e6 / std::max(1.0, config.rateHz))));
+	mDelay = static_cast<uint64_t>(std::max<int64_t>(0, config.delay.count()));
+	mMaxHold = static_cast<uint64_t>(std::max<int64_t>(0, config.maxHold.count()));
+}
+
+void Aligner::push(const EventFrame& frame)
+{
+	for (int i = 0; i < MaxControllers; ++i) {
+		if (!frame.controllers[i].has_value())
+			continue;
+
+		const ControllerEvents& events = *frame.controllers[i];
+		Slot& slot = mSlots[i];
+		slot.id = events.id;
+
+		Sample sample;
+		sample.time = frame.timestamp;
+		sample.groups = gather(events, sample.values);
+
+		if (sample.groups) {
+			// A full ring drops its oldest report; the ones around the next tick are the newest.
+			if (slot.count == Capacity) {
+				slot.first = (slot.first + 1) % Capacity;
+				slot.count--;
+			}
+			slot.samples[(slot.first + slot.count) % Capacity] = sample;
+			slot.count++;
+		}
+
+		events.forEachButtonTransition([&](MoteButton b, Transition t) {
+			slot.buttons.push_back({ frame.timestamp, static_cast<uint8_t>(b), static_cast<uint8_t>(t) });
+		});
+	}
+
+	if (!mStarted) {
+		mStarted = true;
+		mNextTick = (frame.timestamp + mPeriod - 1) / mPeriod * mPeriod;
+	}
+}
+
+bool Aligner::next(uint64_t now, EventFrame& out)
+{
+	while (mStarted && mNextTick + mDelay <= now) {
+		// After a stall, skip the ticks that are already late, so the added latency stays bounded.
+		const uint64_t late = (now - mDelay - mNextTick) / mPeriod;
+		if (late > 1) {
+			mNextTick += (late - 1) * mPeriod;
+			mStats.skipped += late - 1;
+		}
+
+		const uint64_t tick = mNextTick;
+		mNextTick += mPeriod;
+
+		out.sequence = mSequence;
+		out.timestamp = tick;
+		out.alignmentErrorMicros = 0;
+
+		bool any = false;
+		for (int i = 0; i < MaxControllers; ++i) {
+			Slot& slot = mSlots[i];
+			out.controllers[i].reset();
+
+			// Reports at or before the tick (the last one is s0) and the first one after it (s1).
+			int before = 0;
+			while (before < slot.count && sample(slot, before).time <= tick)
+				before++;
+
+			// Reports older than s0 are no longer needed.
+			if (before > 1) {
+				slot.first = (slot.first + before - 1) % Capacity;
+				slot.count -= before - 1;
+				before = 1;
+			}
+
+			ControllerEvents events;
+			events.id = slot.id;
+			bool present = false;
+
+			if (before == 1 && tick - sample(slot, 0).time <= mMaxHold) {
+				const Sample& s0 = sample(slot, 0);
+				uint64_t error = tick - s0.time;
+
+				if (slot.count > 1) {
+					const Sample& s1 = sample(slot, 1);
+					const float t = static_cast<float>(tick - s0.time) / static_cast<float>(s1.time - s0.time);
+					float values[Channels];
+
+					for (int g = 0; g < GroupCount; ++g) {
+						if (!(s0.groups & (1u << g)))
+							continue;
+
+						const GroupRange& range = kGroups[g];
+						const bool both = s1.groups & (1u << g);
+						for (int c = range.begin; c < range.end; ++c) {
+							const float a = s0.values[c];
+							if (!both)
+								values[c] = a;
+							else if (range.wrap & (1u << (c - range.begin)))
+								values[c] = wrapDegrees(a + wrapDegrees(s1.values[c] - a) * t);
+							else
+								values[c] = a + (s1.values[c] - a) * t;
+						}
+					}
+
+					scatter(s0.groups, values, events);
+					error = std::min(error, s1.time - tick);
+					mStats.interpolated++;
+				}
+				else {
+					scatter(s0.groups, s0.values, events);
+					mStats.held++;
+				}
+
+				present = true;
+				mErrorSum += static_cast<double>(error);
+				mErrorCount++;
+				mStats.maxErrorMicros = std::max(mStats.maxErrorMicros, error);
+				out.alignmentErrorMicros = std::max<uint32_t>(out.alignmentErrorMicros, static_cast<uint32_t>(error));
+			}
+
+			// Transitions up to the tick, in order; merged like coalesced frames.
+			size_t taken = 0;
+			while (taken < slot.buttons.size() && slot.buttons[taken].time <= tick) {
+				const ButtonSample& b = slot.buttons[taken++];
+				events.moteButtonTransitions[b.button] = static_cast<Transition>(b.transition);
+				events.buttonEvents.push_back({ static_cast<MoteButton>(b.button), static_cast<Transition>(b.transition) });
+			}
+			if (taken) {
+				slot.buttons.erase(slot.buttons.begin(), slot.buttons.begin() + taken);
+				present = true;
+			}
+
+			if (present) {
+				out.controllers[i] = std::move(events);
+				any = true;
+			}
+		}
+
+		if (!any)
+			continue;
+
+		mSequence++;
+
+		const uint64_t latency = now - tick;
+		mStats.frames++;
+		mLatencySum += static_cast<double>(latency);
+		mStats.maxLatencyMicros = std::max(mStats.maxLatencyMicros, latency);
+		mStats.meanLatencyMicros = mLatencySum / static_cast<double>(mStats.frames);
+		mStats.meanErrorMicros = mErrorCount ? mErrorSum / static_cast<double>(mErrorCount) : 0.0;
+
+		{
+			std::lock_guard<std::mutex> lock(mStatsMutex);
+			mPublishedStats = mStats;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void Aligner::reset(int slot)
+{
+	if (slot < 0 || slot >= MaxControllers)
+		return;
+
+	mSlots[slot].count = 0;
+	mSlots[slot].first = 0;
+	mSlots[slot].buttons.clear();
+}
+
+AlignmentStats Aligner::stats() const
+{
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+	return mPublishedStats;
+}
+
+//==============================================================================
+//
+// Evaluation
+//
+//==============================================================================
+
+void runAlignmentEvaluation(const AlignmentConfig& config)
+{
+	constexpr double kPi = 3.14159265358979;
+	constexpr uint64_t kDuration = 20000000; // 20 s
+	constexpr uint64_t kStep = 1000;         // Worker wake-ups, 1 ms apart.
+
+	const auto truth = [](int id, uint64_t t, float& roll, float& yaw) {
+		const double s = t * 1e-6;
+		roll = static_cast<float>(60.0 * std::sin(2.0 * kPi * 0.8 * s + id));
+		yaw = wrapDegrees(static_cast<float>(200.0 * s + 50.0 * id)); // wraps around every 1.8 s
+	};
+
+	// Every controller reports about every 10 ms with its own phase and jitter, and drops 2% of its reports.
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<double> jitter(-3000.0, 3000.0), chance(0.0, 1.0);
+
+	std::array<uint64_t, MAX_WIIMOTES> nextReport;
+	for (int i = 0; i < MAX_WIIMOTES; ++i)
+		nextReport[i] = 1000 + 2500 * i;
+
+	Aligner aligner;
+	aligner.configure(config);
+
+	// What a consumer of the raw frames knows: the last report of every controller.
+	std::array<std::optional<Orientation>, MAX_WIIMOTES> last;
+	std::array<uint64_t, MAX_WIIMOTES> lastTime = {};
+
+	double alignedError = 0.0, rawError = 0.0, skew = 0.0;
+	uint64_t count = 0, frames = 0;
+
+	EventFrame aligned;
+	for (uint64_t now = 0; now < kDuration; now += kStep) {
+		EventFrame frame;
+		frame.timestamp = now;
+		bool any = false;
+
+		for (int i = 0; i < MAX_WIIMOTES; ++i) {
+			if (nextReport[i] > now)
+				continue;
+
+			nextReport[i] += static_cast<uint64_t>(10000.0 + jitter(rng));
+			if (chance(rng) < 0.02)
+				continue;
+
+			Orientation o;
+			truth(i + 1, now, o.roll, o.yaw);
+
+			ControllerEvents events;
+			events.id = i + 1;
+			events.moteOrientation = o;
+			frame.controllers[i] = events;
+			last[i] = o;
+			lastTime[i] = now;
+			any = true;
+		}
+
+		if (any)
+			aligner.push(frame);
+
+		while (aligner.next(now, aligned)) {
+			frames++;
+
+			// Spread of the report times a raw consumer would combine at this moment.
+			uint64_t lo = UINT64_MAX, hi = 0;
+			for (int i = 0; i < MAX_WIIMOTES; ++i) {
+				lo = std::min(lo, lastTime[i]);
+				hi = std::max(hi, lastTime[i]);
+			}
+			skew += static_cast<double>(hi - lo);
+
+			for (int i = 0; i < MAX_WIIMOTES; ++i) {
+				const auto& c = aligned.controllers[i];
+				if (!c || !c->moteOrientation || !last[i])
+					continue;
+
+				float roll, yaw;
+				truth(i + 1, aligned.timestamp, roll, yaw);
+				const float dr = c->moteOrientation->roll - roll, dy = wrapDegrees(c->moteOrientation->yaw - yaw);
+				alignedError += dr * dr + dy * dy;
+
+				// A raw consumer takes the latest values as simultaneous, at the newest report time.
+				float rollNow, yawNow;
+				truth(i + 1, hi, rollNow, yawNow);
+				const float rr = last[i]->roll - rollNow, ry = wrapDegrees(last[i]->yaw - yawNow);
+				rawError += rr * rr + ry * ry;
+				count += 2;
+			}
+		}
+	}
+
+	const AlignmentStats stats = aligner.stats();
+	ofLogNotice() << "Alignment evaluation: " << MAX_WIIMOTES << " controllers at ~100 Hz with 3 ms jitter, "
+		<< config.rateHz << " Hz clock, " << config.delay.count() / 1000.0 << " ms delay, " << frames << " frames";
+	ofLogNotice() << "  rms error of aligned values " << std::sqrt(alignedError / std::max<uint64_t>(1, count))
+		<< " deg, of the latest raw values " << std::sqrt(rawError / std::max<uint64_t>(1, count))
+		<< " deg (raw report times " << skew / std::max<uint64_t>(1, frames) / 1000.0 << " ms apart)";
+	ofLogNotice() << "  alignment error mean " << stats.meanErrorMicros / 1000.0 << " ms, max " << stats.maxErrorMicros / 1000.0
+		<< " ms; added latency mean " << stats.meanLatencyMicros / 1000.0 << " ms, max " << stats.maxLatencyMicros / 1000.0
+		<< " ms; " << stats.interpolated << " interpolated, " << stats.held << " held, " << stats.skipped << " skipped";
+}
+
+} // namespace Wiimote
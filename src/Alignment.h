@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Wiimote
+{
+
+struct EventFrame;
+
+struct AlignmentConfig
+{
+	bool enabled = false;
+
+	// Rate of the common clock aligned frames are emitted on.
+	double rateHz = 100.0;
+
+	// How far the clock runs behind real time, so that the report after a
+	// tick has usually arrived and can be interpolated against. The added
+	// latency is this plus at most one clock period.
+	std::chrono::microseconds delay{ 15000 };
+
+	// A controller without a report for this long is left out of aligned
+	// frames until it reports again; until then, its last values are held.
+	std::chrono::microseconds maxHold{ 100000 };
+};
+
+struct AlignmentStats
+{
+	uint64_t frames = 0;       // Aligned frames emitted.
+	uint64_t interpolated = 0; // Controller samples interpolated between two reports.
+	uint64_t held = 0;         // Controller samples holding the last report (none later within the delay).
+	uint64_t skipped = 0;      // Ticks skipped to catch up after the worker stalled.
+
+	// Alignment error: distance from a tick to the nearest report its values were built from.
+	double meanErrorMicros = 0.0;
+	uint64_t maxErrorMicros = 0;
+
+	// Added latency: time from a tick to the emission of its frame.
+	double meanLatencyMicros = 0.0;
+	uint64_t maxLatencyMicros = 0;
+};
+
+/**
+ *	Resamples the controllers of irregular poll frames onto a common
+ *	fixed-rate clock, run on the worker thread after smoothing and
+ *	prediction.
+ *
+ *	Every report is kept with its poll timestamp. Once a tick is older
+ *	than the configured delay, the continuous channels of each controller
+ *	are interpolated between the reports around it (angles the short way
+ *	round), or held at the last report if no later one came in time, and
+ *	all controllers are emitted in one frame stamped with the tick. Button
+ *	transitions are not interpolated: each goes, in order, into the first
+ *	frame at or after it.
+ */
+class Aligner
+{
+public:
+	static constexpr int MaxControllers = 4; // MAX_WIIMOTES
+	static constexpr int Capacity = 16;      // Reports kept per controller.
+	static constexpr int Channels = 27;      // Continuous values per report, predicted ones included.
+
+	void configure(const AlignmentConfig& config);
+
+	// Adds the reports of a polled frame.
+	void push(const EventFrame& frame);
+
+	// Writes the next aligned frame that is due at now; false once none is.
+	bool next(uint64_t now, EventFrame& out);
+
+	// Forgets a controller, e.g. after it disconnected.
+	void reset(int slot);
+
+	// Thread-safe snapshot, updated with every aligned frame.
+	AlignmentStats stats() const;
+
+private:
+	struct Sample
+	{
+		uint64_t time = 0;
+		uint32_t groups = 0; // Channel groups present, see Alignment.cpp.
+		float values[Channels];
+	};
+
+	struct ButtonSample
+	{
+		uint64_t time = 0;
+		uint8_t button = 0;
+		uint8_t transition = 0;
+	};
+
+	struct Slot
+	{
+		int id = 0;
+		std::array<Sample, Capacity> samples;
+		int first = 0; // Oldest sample in the ring.
+		int count = 0;
+		std::vector<ButtonSample> buttons;
+	};
+
+	const Sample& sample(const Slot& slot, int i) const { return slot.samples[(slot.first + i) % Capacity]; }
+
+	uint64_t mPeriod = 10000;
+	uint64_t mDelay = 15000;
+	uint64_t mMaxHold = 100000;
+
+	bool mStarted = false;
+	uint64_t mNextTick = 0;
+	uint32_t mSequence = 0;
+
+	std::array<Slot, MaxControllers> mSlots;
+
+	AlignmentStats mStats;
+	double mErrorSum = 0.0;
+	uint64_t mErrorCount = 0;
+	double mLatencySum = 0.0;
+
+	mutable std::mutex mStatsMutex;
+	AlignmentStats mPublishedStats;
+};
+
+// Aligns synthetic motion of four controllers reporting at jittered,
+// unrelated times (with dropouts) and logs the value error against the
+// true motion at the aligned timestamps, next to the alignment error and
+// added latency.
+void runAlignmentEvaluation(const AlignmentConfig& config);
+
+} // namespace Wiimote
@@ -0,0 +1,230 @@
+#include "BinaryOutput.h"
+#include "Trace.h"
+
+#include "ofLog.h"
+
+#include "osc/OscOutboundPacketStream.h"
+#include "osc/OscReceivedElements.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+WiimoBinaryOutput::WiimoBinaryOutput() {
+}
+
+bool WiimoBinaryOutput::setup(const std::string & host, int port)
+{
+	if (mSocket.isOpen() && mSocket.host() == host && mSocket.port() == port)
+		return true;
+
+	bool r = mSocket.connect(host, port);
+	if (r)
+		ofLogNotice() << "Binary: Set up connection to " << host << ":" << port;
+	else
+		ofLogWarning() << "Binary: Failed to set up connection to " << host << ":" << port;
+	return r;
+}
+
+void WiimoBinaryOutput::close()
+{
+	mSocket.close();
+}
+
+bool WiimoBinaryOutput::processEventFrame(const Wiimote::EventFrame & frame)
+{
+	WIIMO_TRACE_ZONE("binary output");
+
+	if (!mSocket.isOpen())
+		return false;
+
+	return sendPacket(encode(frame, mNode, mSequence, mBuffer.data(), mBuffer.size()));
+}
+
+bool WiimoBinaryOutput::processWireFrame(const WiimoWire::Frame & frame)
+{
+	WIIMO_TRACE_ZONE("binary output");
+
+	if (!mSocket.isOpen())
+		return false;
+
+	return sendPacket(encode(frame, mSequence, mBuffer.data(), mBuffer.size()));
+}
+
+bool WiimoBinaryOutput::sendPacket(size_t size)
+{
+	if (!mSocket.send(mBuffer.data(), size)) {
+		mSendFailures++;
+		return false;
+	}
+
+	// Numbered per packet sent, not per frame polled: frames the manager
+	// merged or dropped leave no gap, so a receiver only sees real loss.
+	mSequence++;
+	mBytesSent += size;
+	mPacketsSent++;
+	return true;
+}
+
+/*static*/ WiimoWire::Controller WiimoBinaryOutput::toWire(const Wiimote::ControllerEvents & events)
+{
+	WiimoWire::Controller c;
+	c.id = static_cast<uint8_t>(events.id);
+
+	// Coalesced events can set both bits for a button that was pressed and released.
+	events.forEachButtonTransition([&](Wiimote::MoteButton b, Wiimote::Transition t) {
+		if (t == Wiimote::TransitionPressed)
+			c.pressed |= uint16_t(1) << b;
+		else if (t == Wiimote::TransitionReleased)
+			c.released |= uint16_t(1) << b;
+	});
+
+	if (events.moteOrientation) {
+		auto & rpy = *events.moteOrientation;
+		c.fields |= WiimoWire::FieldMote;
+		c.mote[0] = rpy.roll;
+		c.mote[1] = rpy.pitch;
+		c.mote[2] = rpy.yaw;
+	}
+
+	if (events.chuckOrientation) {
+		auto & rpy = *events.chuckOrientation;
+		c.fields |= WiimoWire::FieldChuck;
+		c.chuck[0] = rpy.roll;
+		c.chuck[1] = rpy.pitch;
+		c.chuck[2] = rpy.yaw;
+	}
+
+	if (events.chuckJoystick) {
+		auto & joy = *events.chuckJoystick;
+		c.fields |= WiimoWire::FieldJoystick;
+		c.joystick[0] = joy.angle;
+		c.joystick[1] = joy.magni;
+		c.joystick[2] = joy.x;
+		c.joystick[3] = joy.y;
+	}
+
+	if (events.balanceBoard) {
+		auto & b = *events.balanceBoard;
+		c.fields |= WiimoWire::FieldBoard;
+		c.board[0] = b.x;
+		c.board[1] = b.y;
+		c.board[2] = b.total;
+		c.board[3] = b.tr;
+		c.board[4] = b.tl;
+		c.board[5] = b.br;
+		c.board[6] = b.bl;
+	}
+
+	return c;
+}
+
+/*static*/ size_t WiimoBinaryOutput::encode(const Wiimote::EventFrame & frame, uint16_t node, uint32_t sequence, uint8_t * buffer, size_t capacity)
+{
+	WiimoWire::Writer writer(buffer, capacity);
+	writer.begin(node, sequence, frame.timestamp);
+
+	// Frames are indexed by slot, packets ordered by id.
+	std::array<const Wiimote::ControllerEvents *, MAX_WIIMOTES> controllers;
+	size_t count = 0;
+	for (auto & events : frame.controllers) {
+		if (events.has_value())
+			controllers[count++] = &*events;
+	}
+	std::sort(controllers.begin(), controllers.begin() + count, [](auto a, auto b) { return a->id < b->id; });
+
+	for (size_t i = 0; i < count; ++i)
+		writer.add(toWire(*controllers[i]));
+
+	return writer.finish();
+}
+
+/*static*/ size_t WiimoBinaryOutput::encode(const WiimoWire::Frame & frame, uint32_t sequence, uint8_t * buffer, size_t capacity)
+{
+	WiimoWire::Writer writer(buffer, capacity);
+	writer.begin(frame.node, sequence, frame.timestamp);
+
+	for (size_t i = 0; i < frame.count; ++i)
+		writer.add(frame.controllers[i]);
+
+	return writer.finish();
+}
+
+//==============================================================================
+//
+// Benchmark
+//
+//==============================================================================
+
+void runWireBenchmark()
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int iterations = 200000;
+	constexpr double frameRate = 100.0;
+
+	Wiimote::EventFrame frame;
+	for (int i = 0; i < MAX_WIIMOTES; ++i) {
+		Wiimote::ControllerEvents events;
+		events.id = i + 1;
+		events.moteButtonTransitions[Wiimote::MoteButton_A] = Wiimote::TransitionPressed;
+		events.moteOrientation = Wiimote::Orientation{ 1.0f, 2.0f, 3.0f };
+		events.chuckJoystick = Wiimote::Joystick{ 45.0f, 0.5f, 0.3f, 0.3f };
+		frame.controllers[i] = events;
+	}
+
+	// Binary: one datagram per frame.
+	std::array<uint8_t, WiimoWire::MaxPacketSize> binary;
+	size_t binarySize = WiimoBinaryOutput::encode(frame, 0, 0, binary.data(), binary.size());
+
+	WiimoWire::Frame decoded;
+	float sink = 0.0f;
+	auto start = Clock::now();
+	for (int n = 0; n < iterations; ++n) {
+		WiimoWire::decode(binary.data(), binarySize, decoded);
+		sink += decoded.controllers[decoded.count - 1].mote[0];
+	}
+	double binaryNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	// OSC: the messages WiimoOscOutput sends for the same frame, one datagram each.
+	std::vector<std::vector<char>> packets;
+	for (int i = 0; i < MAX_WIIMOTES; ++i) {
+		std::string prefix = "/wiimo/" + std::to_string(i + 1);
+		char buffer[256];
+
+		osc::OutboundPacketStream button(buffer, sizeof(buffer));
+		button << osc::BeginMessage((prefix + "/mote/button/" + std::to_string(Wiimote::MoteButton_A)).c_str()) << true << osc::EndMessage;
+		packets.emplace_back(button.Data(), button.Data() + button.Size());
+
+		osc::OutboundPacketStream rpy(buffer, sizeof(buffer));
+		rpy << osc::BeginMessage((prefix + "/mote/rpy").c_str()) << 1.0f << 2.0f << 3.0f << osc::EndMessage;
+		packets.emplace_back(rpy.Data(), rpy.Data() + rpy.Size());
+
+		osc::OutboundPacketStream joy(buffer, sizeof(buffer));
+		joy << osc::BeginMessage((prefix + "/chuck/joy").c_str()) << 45.0f << 0.5f << 0.3f << 0.3f << osc::EndMessage;
+		packets.emplace_back(joy.Data(), joy.Data() + joy.Size());
+	}
+
+	size_t oscSize = 0;
+	for (auto & p : packets)
+		oscSize += p.size();
+
+	start = Clock::now();
+	for (int n = 0; n < iterations; ++n) {
+		for (auto & p : packets) {
+			osc::ReceivedPacket packet(p.data(), static_cast<osc::osc_bundle_element_size_t>(p.size()));
+			osc::ReceivedMessage msg(packet);
+			for (auto it = msg.ArgumentsBegin(); it != msg.ArgumentsEnd(); ++it) {
+				if (it->IsFloat())
+					sink += it->AsFloatUnchecked();
+			}
+		}
+	}
+	double oscNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	ofLogNotice() << "Wire benchmark (4 controllers, rpy + joystick + 1 button, " << frameRate << " Hz):";
+	ofLogNotice() << "  binary: " << binarySize << " B/frame in 1 datagram, " << binarySize * frameRate / 1000.0 << " kB/s, decode " << binaryNs << " ns/frame";
+	ofLogNotice() << "  OSC:    " << oscSize << " B/frame in " << packets.size() << " datagrams, " << oscSize * frameRate / 1000.0 << " kB/s, decode " << oscNs << " ns/frame";
+	ofLogVerbose() << "(checksum " << sink << ")";
+}
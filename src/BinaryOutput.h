@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "WiimoteManager.h"
+#include "WiimoWire.h"
+#include "Socket.h"
+
+/**
+ *	Sends every event frame as a single datagram in the compact binary
+ *	format described in WiimoWire.h, as an alternative to OSC.
+ */
+class WiimoBinaryOutput
+{
+	Net::UdpSocket mSocket;
+	std::array<uint8_t, WiimoWire::MaxPacketSize> mBuffer;
+	uint16_t mNode = 0;
+	uint32_t mSequence = 0; // Of the next packet; advances only when one is sent.
+
+	uint64_t mBytesSent = 0;
+	uint64_t mPacketsSent = 0;
+	uint64_t mSendFailures = 0;
+
+public:
+	WiimoBinaryOutput();
+
+	bool setup(const std::string & host, int port);
+	void close();
+	bool isReady() const { return mSocket.isOpen(); }
+
+	// Node id sent with every frame; non-zero to relay to an aggregator (see WiimoAggregator).
+	void setNode(uint16_t node) { mNode = node; }
+	uint16_t node() const { return mNode; }
+
+	bool processEventFrame(const Wiimote::EventFrame & frame);
+
+	// Re-emits a decoded frame, e.g. one combined by the aggregator. It is
+	// numbered in the same sequence as local frames.
+	bool processWireFrame(const WiimoWire::Frame & frame);
+
+	uint64_t bytesSent() const { return mBytesSent; }
+	uint64_t packetsSent() const { return mPacketsSent; }
+	uint64_t sendFailures() const { return mSendFailures; }
+
+	static WiimoWire::Controller toWire(const Wiimote::ControllerEvents & events);
+	static size_t encode(const Wiimote::EventFrame & frame, uint16_t node, uint32_t sequence, uint8_t * buffer, size_t capacity);
+	static size_t encode(const WiimoWire::Frame & frame, uint32_t sequence, uint8_t * buffer, size_t capacity);
+
+private:
+	bool sendPacket(size_t size);
+};
+
+// Compares packet size and receiver decode cost of a full four-controller
+// frame in the binary format and as the equivalent OSC messages.
+void runWireBenchmark();
@@ -0,0 +1,90 @@
+#include "Control.h"
+
+#include <cstdlib>
+
+WiimoOscControl::WiimoOscControl() {
+}
+
+bool WiimoOscControl::setup(int port)
+{
+	if (mReceiver.isListening() && mReceiver.getPort() == port)
+		return true;
+
+	mReceiver.stop();
+	bool r = mReceiver.setup(port);
+	if (r)
+		ofLogNotice() << "OSC: Listening for commands on port " << port;
+	else
+		ofLogWarning() << "OSC: Failed to listen for commands on port " << port;
+	return r;
+}
+
+void WiimoOscControl::update(Wiimote::Manager & manager)
+{
+	ofxOscMessage msg;
+	while (mReceiver.hasWaitingMessages()) {
+		if (!mReceiver.getNextMessage(msg))
+			break;
+
+		Wiimote::Command command;
+		if (parseCommand(msg, command))
+			manager.sendCommand(command);
+		else
+			ofLogWarning() << "OSC: Ignoring unknown command " << msg.getAddress();
+	}
+}
+
+/*static*/ bool WiimoOscControl::parseCommand(const ofxOscMessage & msg, Wiimote::Command & command)
+{
+	static const std::string prefix = "/wiimo/";
+
+	const std::string & addr = msg.getAddress();
+	if (addr.compare(0, prefix.size(), prefix) != 0)
+		return false;
+
+	char* end = nullptr;
+	long id = std::strtol(addr.c_str() + prefix.size(), &end, 10);
+	if (end == addr.c_str() + prefix.size() || id < 0)
+		return false;
+
+	std::string name = end;
+	if (name == "/cmd/ir")
+		command.type = Wiimote::CommandIR;
+	else if (name == "/cmd/motion")
+		command.type = Wiimote::CommandMotion;
+	else if (name == "/cmd/motionplus")
+		command.type = Wiimote::CommandMotionPlus;
+	else if (name == "/cmd/rumble")
+		command.type = Wiimote::CommandRumble;
+	else if (name == "/cmd/leds")
+		command.type = Wiimote::CommandLeds;
+	else if (name == "/cmd/profile")
+		command.type = Wiimote::CommandProfile;
+	else
+		return false;
+
+	if (msg.getNumArgs() < 1)
+		return false;
+
+	switch (msg.getArgType(0)) {
+	case OFXOSC_TYPE_STRING:
+		if (auto profile = Wiimote::Manager::profileFromName(msg.getArgAsString(0)); profile && command.type == Wiimote::CommandProfile)
+			command.value = static_cast<int>(*profile);
+		else
+			return false;
+		break;
+	case OFXOSC_TYPE_TRUE:
+	case OFXOSC_TYPE_FALSE:
+		command.value = msg.getArgAsBool(0) ? 1 : 0;
+		break;
+	case OFXOSC_TYPE_FLOAT:
+		command.value = static_cast<int>(msg.getArgAsFloat(0));
+		break;
+	default:
+		command.value = msg.getArgAsInt32(0);
+		break;
+	}
+
+	command.id = static_cast<int>(id);
+	return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ofxOsc.h>
+
+#include <string>
+
+#include "WiimoteManager.h"
+
+/**
+ *	Receives OSC commands and forwards them to the wiimote worker:
+ *
+ *	  /wiimo/N/cmd/ir          <on>
+ *	  /wiimo/N/cmd/motion      <on>
+ *	  /wiimo/N/cmd/motionplus  <on>
+ *	  /wiimo/N/cmd/rumble      <on>
+ *	  /wiimo/N/cmd/leds        <mask>
+ *	  /wiimo/N/cmd/profile     <name>
+ *
+ *	N is the controller id, or 0 for all controllers. Arguments may be
+ *	int, float or bool.
+ */
+class WiimoOscControl
+{
+	ofxOscReceiver mReceiver;
+
+public:
+	WiimoOscControl();
+
+	bool setup(int port);
+	void update(Wiimote::Manager & manager);
+
+	static bool parseCommand(const ofxOscMessage & msg, Wiimote::Command & command);
+};
@@ -0,0 +1,104 @@
+#include "DeviceRegistry.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace Wiimote
+{
+
+bool DeviceRegistry::load(const std::string& path)
+{
+	mPath = path;
+	mDevices.clear();
+
+	std::ifstream in(path);
+	if (!in)
+		return false;
+
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream ss(line);
+		DeviceRecord record;
+		unsigned long profile = Profile::Full;
+		if (!(ss >> record.address >> record.id) || record.id < 1 || record.id > MaxId) {
+			ofLogWarning() << "Registry: Ignoring malformed line '" << line << "'";
+			continue;
+		}
+		if (ss >> std::hex >> profile)
+			record.profile = static_cast<StreamMask>(profile);
+
+		if (find(record.address))
+			continue;
+		mDevices.push_back(record);
+	}
+
+	ofLogNotice() << "Registry: Loaded " << mDevices.size() << " known controller(s) from " << path;
+	return true;
+}
+
+bool DeviceRegistry::save() const
+{
+	if (mPath.empty())
+		return false;
+
+	std::ofstream out(mPath, std::ios::trunc);
+	if (!out) {
+		ofLogWarning() << "Registry: Could not write " << mPath;
+		return false;
+	}
+
+	out << "# wiimo known controllers: <address> <id> <profile mask (hex)>\n";
+	for (const DeviceRecord& record : mDevices)
+		out << record.address << " " << record.id << " " << std::hex << record.profile << std::dec << "\n";
+
+	return true;
+}
+
+const DeviceRecord* DeviceRegistry::find(const std::string& address) const
+{
+	auto it = std::find_if(mDevices.begin(), mDevices.end(), [&](const DeviceRecord& r) { return r.address == address; });
+	return it == mDevices.end() ? nullptr : &*it;
+}
+
+const DeviceRecord& DeviceRegistry::assign(const std::string& address, StreamMask profile, uint32_t reserved)
+{
+	if (const DeviceRecord* record = find(address))
+		return *record;
+
+	int id = 1;
+	while (id <= MaxId && ((reserved & (uint32_t(1) << (id - 1)))
+		|| std::any_of(mDevices.begin(), mDevices.end(), [&](const DeviceRecord& r) { return r.id == id; })))
+		++id;
+
+	if (id > MaxId && !mDevices.empty()) {
+		// Registry full: recycle the oldest entry's id.
+		id = mDevices.front().id;
+		mDevices.erase(mDevices.begin());
+	}
+	else if (id > MaxId) {
+		// Every id is reserved elsewhere; share the last one rather than fail.
+		ofLogWarning() << "Registry: No free id for " << address;
+		id = MaxId;
+	}
+
+	mDevices.push_back({ address, id, profile });
+	return mDevices.back();
+}
+
+bool DeviceRegistry::setProfile(const std::string& address, StreamMask profile)
+{
+	auto it = std::find_if(mDevices.begin(), mDevices.end(), [&](const DeviceRecord& r) { return r.address == address; });
+	if (it == mDevices.end() || it->profile == profile)
+		return false;
+
+	it->profile = profile;
+	return true;
+}
+
+} // namespace Wiimote
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "WiimoteManager.h"
+
+namespace Wiimote
+{
+
+struct DeviceRecord
+{
+	std::string address;          // Bluetooth address, "00:1E:35:3B:7E:6D"
+	int id = 0;                   // Controller id used in /wiimo/<id>/...
+	StreamMask profile = Profile::Full;
+};
+
+/**
+ *	Known controllers, persisted as a small text file with one device per
+ *	line: "<address> <id> <profile mask>". Used to reconnect directly to
+ *	known addresses on start-up and to keep controller ids stable across
+ *	restarts, independent of discovery order.
+ */
+class DeviceRegistry
+{
+public:
+	static constexpr int MaxId = 32;
+
+	bool load(const std::string& path);
+	bool save() const;
+
+	const std::vector<DeviceRecord>& devices() const { return mDevices; }
+	const DeviceRecord* find(const std::string& address) const;
+
+	// Returns the record for address, registering it with the lowest free id
+	// if unknown. Ids in reserved (bit id - 1) are used elsewhere and skipped.
+	const DeviceRecord& assign(const std::string& address, StreamMask profile, uint32_t reserved = 0);
+
+	// Returns true if the record changed.
+	bool setProfile(const std::string& address, StreamMask profile);
+
+private:
+	std::string mPath;
+	std::vector<DeviceRecord> mDevices;
+};
+
+} // namespace Wiimote
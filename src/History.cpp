@@ -0,0 +1,343 @@
+#include "History.h"
+#include "WiimoteManager.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+
+namespace Wiimote
+{
+
+static constexpr StreamMask kHistoryStreamMasks[HistoryStreamCount] = {
+	StreamMoteOrientation,
+	StreamChuckOrientation,
+	StreamChuckJoystick,
+	StreamBalanceBoard,
+};
+
+static_assert(HistoryRecordableStreams == (StreamMoteOrientation | StreamChuckOrientation | StreamChuckJoystick | StreamBalanceBoard),
+	"HistoryRecordableStreams must cover the history streams");
+static_assert(History::MaxControllers == MAX_WIIMOTES, "One set of rings per wiimote slot.");
+
+static size_t roundUpToPowerOfTwo(size_t n)
+{
+	size_t p = 16;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+HistoryRing::HistoryRing(size_t capacity, std::chrono::microseconds statsWindow)
+	: mMask(roundUpToPowerOfTwo(capacity) - 1)
+	, mWindow(static_cast<uint64_t>(std::max<int64_t>(0, statsWindow.count())))
+	, mSamples(new HistorySample[mMask + 1])
+{
+	for (int c = 0; c < HistorySample::Values; ++c) {
+		mMinQueue[c].reset(new uint32_t[mMask + 1]);
+		mMaxQueue[c].reset(new uint32_t[mMask + 1]);
+	}
+}
+
+void HistoryRing::push(uint64_t timestamp, const float* values)
+{
+	const uint64_t seq = mHead.load(std::memory_order_relaxed);
+
+	HistorySample& sample = mSamples[seq & mMask];
+	sample.timestamp = timestamp;
+	std::memcpy(sample.values, values, sizeof(sample.values));
+
+	mHead.store(seq + 1, std::memory_order_release);
+	updateStats(seq, sample);
+}
+
+void HistoryRing::updateStats(uint64_t seq, const HistorySample& sample)
+{
+	const auto value = [&](uint64_t s, int c) { return mSamples[s & mMask].values[c]; };
+
+	// Leave the window: samples too old, and always the one the next push overwrites.
+	while (mTail < seq && (sample.timestamp - mSamples[mTail & mMask].timestamp > mWindow || seq - mTail >= mMask)) {
+		for (int c = 0; c < HistorySample::Values; ++c) {
+			const double v = value(mTail, c);
+			mSum[c] -= v;
+			mSumSquares[c] -= v * v;
+			if (mMinEnd[c] > mMinBegin[c] && mMinQueue[c][mMinBegin[c] & mMask] == static_cast<uint32_t>(mTail))
+				mMinBegin[c]++;
+			if (mMaxEnd[c] > mMaxBegin[c] && mMaxQueue[c][mMaxBegin[c] & mMask] == static_cast<uint32_t>(mTail))
+				mMaxBegin[c]++;
+		}
+		mTail++;
+	}
+
+	for (int c = 0; c < HistorySample::Values; ++c) {
+		const float v = sample.values[c];
+		mSum[c] += v;
+		mSumSquares[c] += static_cast<double>(v) * v;
+
+		while (mMinEnd[c] > mMinBegin[c] && value(mMinQueue[c][(mMinEnd[c] - 1) & mMask], c) >= v)
+			mMinEnd[c]--;
+		mMinQueue[c][mMinEnd[c]++ & mMask] = static_cast<uint32_t>(seq);
+
+		while (mMaxEnd[c] > mMaxBegin[c] && value(mMaxQueue[c][(mMaxEnd[c] - 1) & mMask], c) <= v)
+			mMaxEnd[c]--;
+		mMaxQueue[c][mMaxEnd[c]++ & mMask] = static_cast<uint32_t>(seq);
+	}
+
+	// Re-add the sums once per lap, so rounding errors of the running updates cannot accumulate.
+	if ((seq & mMask) == mMask) {
+		for (int c = 0; c < HistorySample::Values; ++c) {
+			mSum[c] = mSumSquares[c] = 0.0;
+			for (uint64_t s = mTail; s <= seq; ++s) {
+				const double v = value(s, c);
+				mSum[c] += v;
+				mSumSquares[c] += v * v;
+			}
+		}
+	}
+
+	const uint32_t version = mStatsVersion.load(std::memory_order_relaxed);
+	mStatsVersion.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const size_t count = static_cast<size_t>(seq + 1 - mTail);
+	mStats.count = count;
+	mStats.begin = mSamples[mTail & mMask].timestamp;
+	mStats.end = sample.timestamp;
+	for (int c = 0; c < HistorySample::Values; ++c) {
+		mStats.min[c] = value(mMinQueue[c][mMinBegin[c] & mMask], c);
+		mStats.max[c] = value(mMaxQueue[c][mMaxBegin[c] & mMask], c);
+		mStats.mean[c] = static_cast<float>(mSum[c] / count);
+		mStats.rms[c] = static_cast<float>(std::sqrt(std::max(0.0, mSumSquares[c] / count)));
+	}
+
+	mStatsVersion.store(version + 2, std::memory_order_release);
+}
+
+size_t HistoryRing::copy(uint64_t begin, uint64_t end, HistorySample* out) const
+{
+	const size_t count = static_cast<size_t>(end - begin);
+	const size_t first = static_cast<size_t>(begin & mMask);
+	const size_t head = std::min(count, mMask + 1 - first);
+
+	std::memcpy(out, &mSamples[first], head * sizeof(HistorySample));
+	std::memcpy(out + head, &mSamples[0], (count - head) * sizeof(HistorySample));
+
+	// Drop what the writer may have overwritten while we copied: everything
+	// up to the slot it writes next.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t after = mHead.load(std::memory_order_relaxed);
+	const uint64_t valid = after > mMask ? after - mMask : 0;
+
+	if (begin >= valid)
+		return count;
+
+	const size_t lost = static_cast<size_t>(std::min<uint64_t>(valid - begin, count));
+	std::memmove(out, out + lost, (count - lost) * sizeof(HistorySample));
+	return count - lost;
+}
+
+size_t HistoryRing::last(size_t n, HistorySample* out) const
+{
+	const uint64_t head = mHead.load(std::memory_order_acquire);
+	n = static_cast<size_t>(std::min<uint64_t>({ n, head, mMask }));
+	return n ? copy(head - n, head, out) : 0;
+}
+
+size_t HistoryRing::range(uint64_t from, uint64_t to, HistorySample* out, size_t max) const
+{
+	const uint64_t head = mHead.load(std::memory_order_acquire);
+	const uint64_t oldest = head > mMask ? head - mMask : 0;
+
+	// Timestamps do not decrease: binary search for the first sample at or after t.
+	const auto lowerBound = [&](uint64_t t) {
+		uint64_t lo = oldest, hi = head;
+		while (lo < hi) {
+			const uint64_t mid = lo + (hi - lo) / 2;
+			if (mSamples[mid & mMask].timestamp < t)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	};
+
+	const uint64_t begin = lowerBound(from);
+	const uint64_t end = std::min<uint64_t>(lowerBound(to), begin + max);
+	if (begin >= end)
+		return 0;
+
+	size_t count = copy(begin, end, out);
+
+	// A sample overwritten during the search may have misplaced the bounds.
+	size_t skip = 0;
+	while (skip < count && out[skip].timestamp < from)
+		skip++;
+	while (count > skip && out[count - 1].timestamp >= to)
+		count--;
+	if (skip)
+		std::memmove(out, out + skip, (count - skip) * sizeof(HistorySample));
+	return count - skip;
+}
+
+HistoryStats HistoryRing::stats() const
+{
+	HistoryStats stats;
+	for (;;) {
+		const uint32_t before = mStatsVersion.load(std::memory_order_acquire);
+		if (before & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		stats = mStats;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (mStatsVersion.load(std::memory_order_relaxed) == before)
+			return stats;
+	}
+}
+
+void History::configure(const HistoryConfig& config)
+{
+	mEnabled = config.enabled;
+
+	for (int i = 0; i < MaxControllers; ++i) {
+		for (int s = 0; s < HistoryStreamCount; ++s) {
+			if (mEnabled && (config.streams & kHistoryStreamMasks[s]))
+				mRings[i][s] = std::make_unique<HistoryRing>(config.capacity, config.statsWindow);
+			else
+				mRings[i][s].reset();
+		}
+	}
+}
+
+void History::push(const EventFrame& frame)
+{
+	for (int i = 0; i < MaxControllers; ++i) {
+		if (!frame.controllers[i].has_value())
+			continue;
+
+		const ControllerEvents& events = *frame.controllers[i];
+		const auto record = [&](HistoryStream stream, float a, float b, float c, float d) {
+			if (HistoryRing* ring = mRings[i][stream].get()) {
+				const float values[HistorySample::Values] = { a, b, c, d };
+				ring->setId(events.id);
+				ring->push(frame.timestamp, values);
+			}
+		};
+
+		if (events.moteOrientation)
+			record(HistoryMoteOrientation, events.moteOrientation->roll, events.moteOrientation->pitch, events.moteOrientation->yaw, 0.0f);
+		if (events.chuckOrientation)
+			record(HistoryChuckOrientation, events.chuckOrientation->roll, events.chuckOrientation->pitch, events.chuckOrientation->yaw, 0.0f);
+		if (events.chuckJoystick)
+			record(HistoryChuckJoystick, events.chuckJoystick->x, events.chuckJoystick->y, events.chuckJoystick->magni, events.chuckJoystick->angle);
+		if (events.balanceBoard)
+			record(HistoryBalanceBoard, events.balanceBoard->x, events.balanceBoard->y, events.balanceBoard->total, 0.0f);
+	}
+}
+
+const HistoryRing* History::ring(int id, HistoryStream stream) const
+{
+	if (stream < 0 || stream >= HistoryStreamCount)
+		return nullptr;
+
+	for (int i = 0; i < MaxControllers; ++i) {
+		const HistoryRing* ring = mRings[i][stream].get();
+		if (ring && ring->id() == id)
+			return ring;
+	}
+	return nullptr;
+}
+
+//==============================================================================
+//
+// Benchmark
+//
+//==============================================================================
+
+void runHistoryBenchmark()
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr uint64_t kSamples = 2000000;
+	constexpr uint64_t kPeriod = 10000; // 100 Hz
+
+	HistoryRing ring(1024, std::chrono::seconds(1));
+
+	// A reader querying the last second while the writer runs at full speed.
+	std::atomic<bool> stop{ false };
+	uint64_t queries = 0, returned = 0, torn = 0;
+	std::thread reader([&] {
+		std::vector<HistorySample> window(1024);
+		while (!stop.load(std::memory_order_relaxed)) {
+			size_t n = ring.last(100, window.data());
+			for (size_t i = 1; i < n; ++i) {
+				if (window[i].timestamp != window[i - 1].timestamp + kPeriod || window[i].values[0] != static_cast<float>(window[i].timestamp / kPeriod % 1000))
+					torn++;
+			}
+			HistoryStats stats = ring.stats();
+			if (stats.count && stats.min[0] > stats.max[0])
+				torn++;
+			returned += n;
+			queries++;
+		}
+	});
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+	auto start = Clock::now();
+	for (uint64_t i = 1; i <= kSamples; ++i) {
+		const float values[HistorySample::Values] = { static_cast<float>(i % 1000), noise(rng), 0.0f, 0.0f };
+		ring.push(i * kPeriod, values);
+	}
+	const double writeNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kSamples;
+
+	stop = true;
+	reader.join();
+
+	// Running statistics against a recomputation over the same window.
+	std::vector<HistorySample> window(1024);
+	const HistoryStats stats = ring.stats();
+	const size_t n = ring.range(stats.begin, stats.end + 1, window.data(), window.size());
+	float minError = 0.0f, meanError = 0.0f, rmsError = 0.0f;
+	{
+		float lo = window[0].values[1], hi = lo;
+		double sum = 0.0, squares = 0.0;
+		for (size_t i = 0; i < n; ++i) {
+			const float v = window[i].values[1];
+			lo = std::min(lo, v);
+			hi = std::max(hi, v);
+			sum += v;
+			squares += static_cast<double>(v) * v;
+		}
+		minError = std::max(std::abs(lo - stats.min[1]), std::abs(hi - stats.max[1]));
+		meanError = std::abs(static_cast<float>(sum / n) - stats.mean[1]);
+		rmsError = std::abs(static_cast<float>(std::sqrt(squares / n)) - stats.rms[1]);
+	}
+
+	// Query cost without a concurrent writer.
+	constexpr int kQueries = 200000;
+	size_t sink = 0;
+	start = Clock::now();
+	for (int i = 0; i < kQueries; ++i)
+		sink += ring.last(100, window.data());
+	const double lastNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kQueries;
+
+	start = Clock::now();
+	for (int i = 0; i < kQueries; ++i)
+		sink += ring.stats().count;
+	const double statsNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kQueries;
+
+	ofLogNotice() << "History benchmark: push " << writeNs << " ns per sample; last(100) " << lastNs << " ns, stats() "
+		<< statsNs << " ns (" << sink % 2 << ")";
+	ofLogNotice() << "  concurrent reader: " << queries << " queries, " << returned << " samples, " << torn << " inconsistent";
+	ofLogNotice() << "  running stats over " << stats.count << " samples vs recomputed: min/max error " << minError
+		<< ", mean error " << meanError << ", rms error " << rmsError;
+}
+
+} // namespace Wiimote
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace Wiimote
+{
+
+struct EventFrame;
+
+// Continuous streams kept in the history, one ring each per controller.
+enum HistoryStream
+{
+	HistoryMoteOrientation,  // roll, pitch, yaw
+	HistoryChuckOrientation, // roll, pitch, yaw
+	HistoryChuckJoystick,    // x, y, magnitude, angle
+	HistoryBalanceBoard,     // x, y, total
+
+	HistoryStreamCount
+};
+
+// The StreamMask bits of the streams above (StreamMoteOrientation through
+// StreamBalanceBoard; checked in History.cpp).
+constexpr uint32_t HistoryRecordableStreams = 0x1E;
+
+struct HistoryConfig
+{
+	bool enabled = false;
+
+	// Samples per controller and stream, rounded up to a power of two
+	// (1024: about 10 s of reports at 100 Hz).
+	size_t capacity = 1024;
+
+	// Time span of the running statistics (HistoryRing::stats()).
+	std::chrono::microseconds statsWindow{ 1000000 };
+
+	// StreamMask of the streams to record, all of them by default; they are
+	// extracted from the devices whether or not anything else subscribes to
+	// them. Other bits are ignored.
+	uint32_t streams = HistoryRecordableStreams;
+};
+
+struct alignas(32) HistorySample
+{
+	static constexpr int Values = 4;
+
+	uint64_t timestamp = 0; // Manager::timestampMicros() of the poll.
+	float values[Values] = {};
+};
+
+struct HistoryStats
+{
+	size_t count = 0; // Samples in the window; the rest is meaningless while 0.
+	uint64_t begin = 0;
+	uint64_t end = 0;
+
+	float min[HistorySample::Values] = {};
+	float max[HistorySample::Values] = {};
+	float mean[HistorySample::Values] = {};
+	float rms[HistorySample::Values] = {};
+};
+
+/**
+ *	Fixed-capacity history of one stream of one controller. Written by the
+ *	worker thread only; any number of threads read it without locks.
+ *
+ *	Readers copy just the samples they ask for and check the write counter
+ *	afterwards, discarding what the writer overwrote meanwhile (so a query
+ *	can return fewer samples than were available when it started). The
+ *	running statistics over the configured window are maintained by the
+ *	writer in O(1) per sample: sums for mean and RMS, monotonic queues for
+ *	min and max. They are published with a sequence lock.
+ */
+class HistoryRing
+{
+public:
+	HistoryRing(size_t capacity, std::chrono::microseconds statsWindow);
+
+	// Writer: appends a sample; timestamps must not decrease.
+	void push(uint64_t timestamp, const float* values);
+
+	// Controller id of the latest sample, 0 before the first.
+	int id() const { return mId.load(std::memory_order_relaxed); }
+	void setId(int id) { mId.store(id, std::memory_order_relaxed); }
+
+	size_t capacity() const { return mMask + 1; }
+
+	// Number of samples ever written.
+	uint64_t written() const { return mHead.load(std::memory_order_acquire); }
+
+	// Copies the newest n samples, oldest first; returns how many were copied.
+	size_t last(size_t n, HistorySample* out) const;
+
+	// Copies the samples with from <= timestamp < to, oldest first, at most max.
+	size_t range(uint64_t from, uint64_t to, HistorySample* out, size_t max) const;
+
+	// Running min/max/mean/RMS over the last statsWindow of samples.
+	HistoryStats stats() const;
+
+private:
+	size_t copy(uint64_t begin, uint64_t end, HistorySample* out) const;
+	void updateStats(uint64_t seq, const HistorySample& sample);
+
+	const size_t mMask;
+	const uint64_t mWindow;
+	std::unique_ptr<HistorySample[]> mSamples;
+
+	alignas(64) std::atomic<uint64_t> mHead{ 0 };
+	std::atomic<int> mId{ 0 };
+
+	// Writer-only window state. Queues hold sequence numbers (low 32 bits)
+	// of samples in the window whose values are increasing (min) or
+	// decreasing (max), per value.
+	alignas(64) uint64_t mTail = 0;
+	std::unique_ptr<uint32_t[]> mMinQueue[HistorySample::Values];
+	std::unique_ptr<uint32_t[]> mMaxQueue[HistorySample::Values];
+	uint64_t mMinBegin[HistorySample::Values] = {}, mMinEnd[HistorySample::Values] = {};
+	uint64_t mMaxBegin[HistorySample::Values] = {}, mMaxEnd[HistorySample::Values] = {};
+	double mSum[HistorySample::Values] = {};
+	double mSumSquares[HistorySample::Values] = {};
+
+	alignas(64) std::atomic<uint32_t> mStatsVersion{ 0 };
+	HistoryStats mStats;
+};
+
+/**
+ *	The rings of all controllers and streams, owned by the manager and fed
+ *	by the worker with every polled frame (after smoothing, or before it for
+ *	Manager::rawHistory()).
+ */
+class History
+{
+public:
+	static constexpr int MaxControllers = 4; // MAX_WIIMOTES
+
+	void configure(const HistoryConfig& config);
+	bool isEnabled() const { return mEnabled; }
+
+	// Writer: records the continuous streams of every controller in the frame.
+	void push(const EventFrame& frame);
+
+	// Ring of a controller id and stream; nullptr if the id was never seen or history is off.
+	const HistoryRing* ring(int id, HistoryStream stream) const;
+
+private:
+	bool mEnabled = false;
+	std::unique_ptr<HistoryRing> mRings[MaxControllers][HistoryStreamCount];
+};
+
+// Measures the write cost and the cost of windowed queries, with a reader
+// thread querying concurrently, and checks the running statistics against
+// a full recomputation.
+void runHistoryBenchmark();
+
+} // namespace Wiimote
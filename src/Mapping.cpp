@@ -0,0 +1,352 @@
+#include "Mapping.h"
+
+#include "ofLog.h"
+
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+
+static const std::map<std::string, int>& sourceNames()
+{
+	static const std::map<std::string, int> names = {
+		{ "mote.roll", WiimoMapping::SourceMoteRoll },
+		{ "mote.pitch", WiimoMapping::SourceMotePitch },
+		{ "mote.yaw", WiimoMapping::SourceMoteYaw },
+		{ "chuck.roll", WiimoMapping::SourceChuckRoll },
+		{ "chuck.pitch", WiimoMapping::SourceChuckPitch },
+		{ "chuck.yaw", WiimoMapping::SourceChuckYaw },
+		{ "joy.angle", WiimoMapping::SourceJoyAngle },
+		{ "joy.magnitude", WiimoMapping::SourceJoyMagnitude },
+		{ "joy.x", WiimoMapping::SourceJoyX },
+		{ "joy.y", WiimoMapping::SourceJoyY },
+		{ "board.x", WiimoMapping::SourceBoardX },
+		{ "board.y", WiimoMapping::SourceBoardY },
+		{ "board.total", WiimoMapping::SourceBoardTotal },
+		{ "board.tr", WiimoMapping::SourceBoardTR },
+		{ "board.tl", WiimoMapping::SourceBoardTL },
+		{ "board.br", WiimoMapping::SourceBoardBR },
+		{ "board.bl", WiimoMapping::SourceBoardBL },
+		{ "button.one", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_One },
+		{ "button.two", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Two },
+		{ "button.b", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_B },
+		{ "button.a", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_A },
+		{ "button.up", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Up },
+		{ "button.down", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Down },
+		{ "button.left", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Left },
+		{ "button.right", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Right },
+		{ "button.minus", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Minus },
+		{ "button.plus", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Plus },
+		{ "button.home", WiimoMapping::SourceButtonBegin + Wiimote::MoteButton_Home },
+	};
+	return names;
+}
+
+/*static*/ uint64_t WiimoMapping::gather(const Wiimote::ControllerEvents& events, float* values)
+{
+	uint64_t present = 0;
+	const auto set = [&](int source, float v) {
+		values[source] = v;
+		present |= uint64_t(1) << source;
+	};
+
+	if (events.moteOrientation) {
+		set(SourceMoteRoll, events.moteOrientation->roll);
+		set(SourceMotePitch, events.moteOrientation->pitch);
+		set(SourceMoteYaw, events.moteOrientation->yaw);
+	}
+	if (events.chuckOrientation) {
+		set(SourceChuckRoll, events.chuckOrientation->roll);
+		set(SourceChuckPitch, events.chuckOrientation->pitch);
+		set(SourceChuckYaw, events.chuckOrientation->yaw);
+	}
+	if (events.chuckJoystick) {
+		set(SourceJoyAngle, events.chuckJoystick->angle);
+		set(SourceJoyMagnitude, events.chuckJoystick->magni);
+		set(SourceJoyX, events.chuckJoystick->x);
+		set(SourceJoyY, events.chuckJoystick->y);
+	}
+	if (events.balanceBoard) {
+		auto& b = *events.balanceBoard;
+		set(SourceBoardX, b.x);
+		set(SourceBoardY, b.y);
+		set(SourceBoardTotal, b.total);
+		set(SourceBoardTR, b.tr);
+		set(SourceBoardTL, b.tl);
+		set(SourceBoardBR, b.br);
+		set(SourceBoardBL, b.bl);
+	}
+
+	// Coalesced events: the last transition of a button wins.
+	events.forEachButtonTransition([&](Wiimote::MoteButton b, Wiimote::Transition t) {
+		set(SourceButtonBegin + b, t == Wiimote::TransitionPressed ? 1.0f : 0.0f);
+	});
+
+	return present;
+}
+
+/*static*/ Wiimote::StreamMask WiimoMapping::streamOf(int source)
+{
+	if (source <= SourceMoteYaw)
+		return Wiimote::StreamMoteOrientation;
+	if (source <= SourceChuckYaw)
+		return Wiimote::StreamChuckOrientation;
+	if (source <= SourceJoyY)
+		return Wiimote::StreamChuckJoystick;
+	if (source <= SourceBoardBL)
+		return Wiimote::StreamBalanceBoard;
+	return Wiimote::StreamButtons;
+}
+
+bool WiimoMapping::load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		// A removed file means no mappings, not the previous ones.
+		compile("");
+		return false;
+	}
+
+	std::stringstream text;
+	text << file.rdbuf();
+	compile(text.str());
+
+	ofLogNotice() << "Mapping: loaded " << mCount << " mappings from " << path
+		<< (mDefaults ? "" : " (default messages off)");
+	return true;
+}
+
+void WiimoMapping::compile(const std::string& text)
+{
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	for (auto& program : mPrograms)
+		program.clear();
+	mAddresses.clear();
+	mCount = 0;
+	mDefaults = true;
+	mStreams = 0;
+
+	std::stringstream lines(text);
+	std::string line;
+	int number = 0;
+
+	while (std::getline(lines, line)) {
+		number++;
+		if (auto hash = line.find('#'); hash != std::string::npos)
+			line.erase(hash);
+
+		std::stringstream ss(line);
+		std::string target, source, address;
+		if (!(ss >> target))
+			continue;
+
+		if (target == "default") {
+			std::string value;
+			ss >> value;
+			mDefaults = value != "off";
+			continue;
+		}
+
+		const auto fail = [&](const std::string& why) {
+			ofLogWarning() << "Mapping line " << number << ": " << why << ", skipped.";
+		};
+
+		int id = 0;
+		if (target != "*") {
+			try {
+				id = std::stoi(target);
+			}
+			catch (const std::exception&) {
+				id = -1;
+			}
+			if (id < 1 || id > MaxId) {
+				fail("invalid controller id '" + target + "'");
+				continue;
+			}
+		}
+
+		if (!(ss >> source >> address)) {
+			fail("expected <id|*> <source> <address>");
+			continue;
+		}
+
+		auto it = sourceNames().find(source);
+		if (it == sourceNames().end()) {
+			fail("unknown source '" + source + "'");
+			continue;
+		}
+
+		// Options are collected first and composed below in the documented order.
+		float scale = 1.0f, offset = 0.0f, gamma = 1.0f;
+		float range[4] = {}, clamp[2] = {};
+		bool ranged = false, clamped = false, invert = false, ok = true;
+
+		std::string option;
+		while (ok && ss >> option) {
+			float a, b, c, d;
+			if (option == "scale" && ss >> a) {
+				scale *= a;
+			}
+			else if (option == "offset" && ss >> a) {
+				offset += a;
+			}
+			else if (option == "range" && ss >> a >> b >> c >> d && a != b && c != d) {
+				range[0] = a;
+				range[1] = b;
+				range[2] = c;
+				range[3] = d;
+				ranged = true;
+			}
+			else if (option == "clamp" && ss >> a >> b && a < b) {
+				clamp[0] = a;
+				clamp[1] = b;
+				clamped = true;
+			}
+			else if (option == "curve" && ss >> a && a > 0.0f) {
+				gamma = a;
+			}
+			else if (option == "invert") {
+				invert = true;
+			}
+			else {
+				fail("invalid option '" + option + "'");
+				ok = false;
+			}
+		}
+		if (!ok)
+			continue;
+
+		Instruction ins;
+		ins.source = static_cast<uint8_t>(it->second);
+		ins.curve = gamma != 1.0f;
+		ins.gamma = gamma;
+		ins.scale = scale;
+		ins.offset = offset;
+		ins.lo = -inf;
+		ins.hi = inf;
+
+		if (ranged) {
+			const float s = (range[3] - range[2]) / (range[1] - range[0]);
+			ins.scale *= s;
+			ins.offset = ins.offset * s + range[2] - range[0] * s;
+			ins.lo = std::min(range[2], range[3]);
+			ins.hi = std::max(range[2], range[3]);
+		}
+
+		if (ins.curve && !ranged && !clamped) {
+			clamp[0] = 0.0f;
+			clamp[1] = 1.0f;
+			clamped = true;
+		}
+
+		// Mirroring is affine, so it folds into scale and offset; the range
+		// clamp before it mirrors with it.
+		if (invert) {
+			const float twice = clamped ? clamp[0] + clamp[1] : ranged ? ins.lo + ins.hi : 0.0f;
+			ins.scale = -ins.scale;
+			ins.offset = twice - ins.offset;
+
+			const float lo = twice - ins.hi;
+			ins.hi = twice - ins.lo;
+			ins.lo = lo;
+		}
+
+		// Clamping after a range clamp keeps the tighter bounds.
+		if (clamped) {
+			ins.lo = std::max(ins.lo, clamp[0]);
+			ins.hi = std::min(ins.hi, clamp[1]);
+		}
+
+		if (!(ins.lo < ins.hi)) {
+			fail("empty output range");
+			continue;
+		}
+
+		// Expand the address for every id it applies to.
+		const int first = id ? id : 1;
+		const int last = id ? id : MaxId;
+		for (int k = first; k <= last; ++k) {
+			std::string expanded = address;
+			for (size_t pos; (pos = expanded.find("{id}")) != std::string::npos;)
+				expanded.replace(pos, 4, std::to_string(k));
+
+			ins.address = static_cast<uint32_t>(mAddresses.size());
+			mAddresses.push_back(expanded);
+			mPrograms[k].push_back(ins);
+		}
+
+		mStreams |= streamOf(ins.source);
+		mCount++;
+	}
+}
+
+//==============================================================================
+//
+// Benchmark
+//
+//==============================================================================
+
+void runMappingBenchmark()
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Random mappings over the continuous sources of all controllers.
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> pick(0, WiimoMapping::SourceBoardBL);
+	std::uniform_int_distribution<int> option(0, 3);
+
+	std::vector<std::string> names(WiimoMapping::SourceButtonBegin);
+	for (auto& [name, source] : sourceNames()) {
+		if (source < WiimoMapping::SourceButtonBegin)
+			names[source] = name;
+	}
+
+	for (int mappings : { 256, 1024, 4096 }) {
+		std::stringstream text;
+		for (int i = 0; i < mappings; ++i) {
+			text << "* " << names[pick(rng)] << " /bench/{id}/" << i;
+			switch (option(rng)) {
+			case 0: text << " range -90 90 0 1"; break;
+			case 1: text << " scale 0.01 offset 0.5 clamp 0 1 invert"; break;
+			case 2: text << " range -1 1 0 1 curve 2.2"; break;
+			default: break;
+			}
+			text << '\n';
+		}
+
+		WiimoMapping mapping;
+		mapping.compile(text.str());
+
+		// A frame of four controllers with every continuous stream.
+		std::vector<Wiimote::ControllerEvents> frame(MAX_WIIMOTES);
+		for (int c = 0; c < MAX_WIIMOTES; ++c) {
+			frame[c].id = c + 1;
+			frame[c].moteOrientation = Wiimote::Orientation{ 10.0f, 20.0f, 30.0f };
+			frame[c].chuckOrientation = Wiimote::Orientation{ 5.0f, 6.0f, 7.0f };
+			frame[c].chuckJoystick = Wiimote::Joystick{ 45.0f, 0.5f, 0.3f, 0.4f };
+			frame[c].balanceBoard = Wiimote::BalanceBoard{ 0.1f, 0.2f, 70.0f, 17.0f, 18.0f, 17.5f, 17.5f };
+		}
+
+		uint64_t evaluated = 0;
+		double checksum = 0.0;
+		const auto sink = [&](const std::string& address, float v) {
+			checksum += v + address.size();
+			evaluated++;
+		};
+
+		const int frames = 2000;
+		auto start = Clock::now();
+		for (int f = 0; f < frames; ++f) {
+			for (const auto& events : frame)
+				mapping.evaluate(events, sink);
+		}
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+		ofLogNotice() << "Mapping benchmark: " << mappings << " mappings x " << MAX_WIIMOTES << " controllers, "
+			<< evaluated / frames << " values per frame, " << ns / frames / 1000.0 << " us per frame, "
+			<< ns / std::max<uint64_t>(1, evaluated) << " ns per value (checksum " << checksum << ")";
+	}
+}
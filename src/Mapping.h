@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "WiimoteManager.h"
+
+/**
+ *	User-defined routing of controller values to OSC addresses, with
+ *	scaling, clamping and response curves.
+ *
+ *	The configuration is a text file with one mapping per line:
+ *
+ *	    <id|*> <source> <address> [options]
+ *
+ *	    *  mote.roll   /wiimo/{id}/roll   range -90 90 0 1
+ *	    2  joy.y       /synth/cutoff      clamp -1 1 invert curve 2
+ *	    *  button.a    /wiimo/{id}/fire
+ *
+ *	{id} in the address is replaced by the controller id. Options apply in
+ *	this order, whatever order they are written in:
+ *
+ *	    scale S, offset O    v = x * S + O (scale first; several of each
+ *	                         multiply and add up)
+ *	    range a b c d        maps [a, b] onto [c, d] and clamps to it
+ *	                         (a != b, c != d)
+ *	    invert               mirrors v within the clamp range (or the range,
+ *	                         or around 0)
+ *	    clamp lo hi          limits v to [lo, hi], within the range if given
+ *	    curve g              v = lo + (hi - lo) * t^g, t = (v - lo) / (hi - lo);
+ *	                         implies clamp 0 1 unless a range is given
+ *
+ *	If range, clamp or curve is repeated on a line, its last value is used.
+ *	Lines whose bounds leave no values (e.g. a clamp outside the range) are
+ *	rejected.
+ *
+ *	A line "default off" stops the built-in messages for continuous streams;
+ *	button messages are always sent. '#' starts a comment.
+ *
+ *	load() compiles everything into one flat instruction array per
+ *	controller id, with scale, offset and invert folded into two floats and
+ *	addresses expanded up front, so evaluate() does no allocation, string
+ *	work or lookups per event.
+ */
+class WiimoMapping
+{
+public:
+	enum Source : uint8_t
+	{
+		SourceMoteRoll,
+		SourceMotePitch,
+		SourceMoteYaw,
+		SourceChuckRoll,
+		SourceChuckPitch,
+		SourceChuckYaw,
+		SourceJoyAngle,
+		SourceJoyMagnitude,
+		SourceJoyX,
+		SourceJoyY,
+		SourceBoardX,
+		SourceBoardY,
+		SourceBoardTotal,
+		SourceBoardTR,
+		SourceBoardTL,
+		SourceBoardBR,
+		SourceBoardBL,
+		SourceButtonBegin, // + MoteButton; 1 when pressed, 0 when released
+
+		SourceCount = SourceButtonBegin + Wiimote::MoteButtonEnd
+	};
+
+	static_assert(SourceCount <= 64, "Source presence is a 64-bit mask.");
+
+	static constexpr int MaxId = Wiimote::Manager::MaxSubscriptionId;
+
+	// Replaces the current program with the one in path. Invalid lines are
+	// logged and skipped. Returns false, leaving no mappings, if the file
+	// cannot be read.
+	bool load(const std::string& path);
+
+	// Same, from the text of a configuration.
+	void compile(const std::string& text);
+
+	bool empty() const { return mCount == 0; }
+	size_t size() const { return mCount; }
+	bool sendsDefaults() const { return mDefaults; }
+
+	// Streams the mapped sources come from.
+	Wiimote::StreamMask streams() const { return mStreams; }
+
+	// Calls sink(const std::string& address, float value) for every mapping
+	// of the controller whose source is present in events.
+	template <typename Sink>
+	void evaluate(const Wiimote::ControllerEvents& events, Sink&& sink) const
+	{
+		if (events.id < 1 || events.id > MaxId)
+			return;
+
+		float values[SourceCount];
+		const uint64_t present = gather(events, values);
+		if (!present)
+			return;
+
+		for (const Instruction& ins : mPrograms[events.id]) {
+			if (!((present >> ins.source) & 1))
+				continue;
+
+			float v = std::clamp(values[ins.source] * ins.scale + ins.offset, ins.lo, ins.hi);
+			if (ins.curve)
+				v = ins.lo + (ins.hi - ins.lo) * std::pow((v - ins.lo) / (ins.hi - ins.lo), ins.gamma);
+
+			sink(mAddresses[ins.address], v);
+		}
+	}
+
+	// Reads the sources present in events into values; returns their mask.
+	static uint64_t gather(const Wiimote::ControllerEvents& events, float* values);
+
+	static Wiimote::StreamMask streamOf(int source);
+
+private:
+	struct Instruction
+	{
+		uint8_t source = 0;
+		bool curve = false;
+		uint32_t address = 0;
+
+		float scale = 1.0f;
+		float offset = 0.0f;
+		float lo = 0.0f;
+		float hi = 0.0f;
+		float gamma = 1.0f;
+	};
+
+	std::array<std::vector<Instruction>, MaxId + 1> mPrograms;
+	std::vector<std::string> mAddresses;
+	size_t mCount = 0;
+	bool mDefaults = true;
+	Wiimote::StreamMask mStreams = 0;
+};
+
+// Evaluates thousands of mappings per frame and logs the cost per mapping.
+void runMappingBenchmark();
@@ -0,0 +1,431 @@
+#include "OscTcpTransport.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+	constexpr char SlipEnd = char(0xC0);
+	constexpr char SlipEsc = char(0xDB);
+	constexpr char SlipEscEnd = char(0xDC);
+	constexpr char SlipEscEsc = char(0xDD);
+
+	constexpr std::chrono::milliseconds MinBackoff{ 250 };
+	constexpr std::chrono::milliseconds MaxBackoff{ 8000 };
+}
+
+WiimoOscTcpTransport::WiimoOscTcpTransport() {
+}
+
+bool WiimoOscTcpTransport::setup(const std::string & host, int port, size_t maxQueuedBytes)
+{
+	if (host == mHost && port == mPort)
+		return true;
+
+	close();
+
+	mHost = host;
+	mPort = port;
+	mMaxQueuedBytes = maxQueuedBytes;
+	mBackoff = std::chrono::milliseconds(0);
+
+	ofLogNotice() << "OSC/TCP: Connecting to " << host << ":" << port;
+	connect();
+	return true;
+}
+
+void WiimoOscTcpTransport::close()
+{
+	mSocket.close();
+	mHost.clear();
+	mPort = 0;
+
+	mQueue.clear();
+	mQueuedBytes = 0;
+	mWriteBuffer.clear();
+	mWriteOffset = 0;
+	mWritten.clear();
+	mWrittenPackets = 0;
+	mWasConnected = false;
+}
+
+void WiimoOscTcpTransport::connect()
+{
+	// The next attempt is scheduled up front; a successful connection resets the backoff.
+	mBackoff = std::clamp(mBackoff * 2, MinBackoff, MaxBackoff);
+	mNextAttempt = Clock::now() + mBackoff;
+
+	mSocket.connect(mHost, mPort);
+}
+
+/*static*/ void WiimoOscTcpTransport::slipEncode(const char * data, size_t size, std::string & out)
+{
+	out.clear();
+	out.reserve(size + 8);
+	out.push_back(SlipEnd);
+	for (size_t i = 0; i < size; ++i) {
+		char c = data[i];
+		if (c == SlipEnd) {
+			out.push_back(SlipEsc);
+			out.push_back(SlipEscEnd);
+		}
+		else if (c == SlipEsc) {
+			out.push_back(SlipEsc);
+			out.push_back(SlipEscEsc);
+		}
+		else {
+			out.push_back(c);
+		}
+	}
+	out.push_back(SlipEnd);
+}
+
+bool WiimoOscTcpTransport::enqueue(const char * packet, size_t size, bool critical)
+{
+	if (!isEnabled())
+		return false;
+
+	// Continuous values are worthless once stale, so they are not kept while disconnected.
+	if (!critical && !isConnected()) {
+		mStats.droppedContinuous++;
+		return false;
+	}
+
+	Packet p;
+	p.critical = critical;
+	if (!mSpare.empty()) {
+		p.bytes.swap(mSpare.back());
+		mSpare.pop_back();
+	}
+	slipEncode(packet, size, p.bytes);
+
+	if (mQueuedBytes + p.bytes.size() > mMaxQueuedBytes) {
+		dropForSpace(p.bytes.size(), critical);
+		if (mQueuedBytes + p.bytes.size() > mMaxQueuedBytes) {
+			(critical ? mStats.droppedCritical : mStats.droppedContinuous)++;
+			releasePacket(p);
+			return false;
+		}
+	}
+
+	mQueuedBytes += p.bytes.size();
+	mQueue.push_back(std::move(p));
+	return true;
+}
+
+void WiimoOscTcpTransport::dropForSpace(size_t needed, bool critical)
+{
+	// First the oldest continuous packets, then (only to make room for a
+	// critical packet) the oldest critical ones.
+	for (auto it = mQueue.begin(); it != mQueue.end() && mQueuedBytes + needed > mMaxQueuedBytes;) {
+		if (!it->critical) {
+			mQueuedBytes -= it->bytes.size();
+			mStats.droppedContinuous++;
+			releasePacket(*it);
+			it = mQueue.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	while (critical && !mQueue.empty() && mQueuedBytes + needed > mMaxQueuedBytes) {
+		mQueuedBytes -= mQueue.front().bytes.size();
+		mStats.droppedCritical++;
+		releasePacket(mQueue.front());
+		mQueue.pop_front();
+	}
+}
+
+void WiimoOscTcpTransport::releasePacket(Packet & packet)
+{
+	if (mSpare.size() < 256) {
+		packet.bytes.clear();
+		mSpare.push_back(std::move(packet.bytes));
+	}
+}
+
+void WiimoOscTcpTransport::flush()
+{
+	if (!isEnabled())
+		return;
+
+	auto state = mSocket.update();
+
+	if (state == Net::TcpSocket::StateClosed) {
+		if (mWasConnected) {
+			ofLogWarning() << "OSC/TCP: Connection to " << mHost << ":" << mPort << " lost, reconnecting";
+			mWasConnected = false;
+
+			discardPartialPacket();
+		}
+
+		if (Clock::now() >= mNextAttempt) {
+			mStats.reconnects++;
+			connect();
+		}
+		return;
+	}
+
+	if (state != Net::TcpSocket::StateConnected)
+		return;
+
+	if (!mWasConnected) {
+		ofLogNotice() << "OSC/TCP: Connected to " << mHost << ":" << mPort;
+		mWasConnected = true;
+		mBackoff = std::chrono::milliseconds(0);
+	}
+
+	// Coalesce everything queued into one write, once the previous one is fully out.
+	// While the socket is stalled, packets stay in the (bounded, droppable) queue.
+	if (mWriteOffset == mWriteBuffer.size()) {
+		mWriteBuffer.clear();
+		mWriteOffset = 0;
+		mWritten.clear();
+		mWrittenPackets = 0;
+
+		while (!mQueue.empty()) {
+			Packet & p = mQueue.front();
+			mWriteBuffer.append(p.bytes);
+			mWritten.push_back({ mWriteBuffer.size(), p.critical });
+			mQueuedBytes -= p.bytes.size();
+			releasePacket(p);
+			mQueue.pop_front();
+		}
+	}
+
+	if (mWriteOffset == mWriteBuffer.size())
+		return;
+
+	// On errors the socket closes itself; the next flush() reconnects.
+	int r = mSocket.send(mWriteBuffer.data() + mWriteOffset, mWriteBuffer.size() - mWriteOffset);
+	if (r > 0) {
+		mWriteOffset += static_cast<size_t>(r);
+		mStats.bytesSent += static_cast<uint64_t>(r);
+
+		while (mWrittenPackets < mWritten.size() && mWritten[mWrittenPackets].end <= mWriteOffset) {
+			mWrittenPackets++;
+			mStats.packetsSent++;
+		}
+	}
+}
+
+void WiimoOscTcpTransport::discardPartialPacket()
+{
+	// A partially written packet cannot be resumed on a new stream (the
+	// receiver drops the fragment at the next SLIP END); the packets after
+	// it stay in the buffer and go out first on the next connection.
+	size_t cut = mWrittenPackets ? mWritten[mWrittenPackets - 1].end : 0;
+	if (mWrittenPackets < mWritten.size() && mWriteOffset > cut) {
+		const Written & partial = mWritten[mWrittenPackets++];
+		(partial.critical ? mStats.droppedCritical : mStats.droppedContinuous)++;
+		cut = partial.end;
+	}
+
+	mWriteBuffer.erase(0, cut);
+	mWritten.erase(mWritten.begin(), mWritten.begin() + mWrittenPackets);
+	for (Written & w : mWritten)
+		w.end -= cut;
+
+	mWrittenPackets = 0;
+	mWriteOffset = 0;
+}
+
+//==============================================================================
+//
+// Loopback test
+//
+//==============================================================================
+
+namespace
+{
+	// Test packet: sequence number, critical flag, then filler covering every byte value (SLIP escapes included).
+	void makeTestPacket(uint32_t sequence, bool critical, std::string & out)
+	{
+		out.resize(5 + 48 + sequence % 64);
+		std::memcpy(&out[0], &sequence, 4);
+		out[4] = critical ? 1 : 0;
+		for (size_t i = 5; i < out.size(); ++i)
+			out[i] = static_cast<char>((sequence + i) * 37);
+	}
+
+	/**
+	 *	Receiving end: decodes the SLIP stream of the accepted connection and
+	 *	checks every packet. A fragment left when a connection ends is not a
+	 *	packet; a new connection starts a new stream.
+	 */
+	struct TcpReader
+	{
+		Net::TcpListener listener;
+		std::string frame;
+		bool escaped = false;
+
+		uint64_t received = 0;
+		uint64_t critical = 0;
+		uint64_t malformed = 0;
+		uint64_t reordered = 0;
+		int64_t lastSequence = -1;
+
+		// Reads until nothing arrived for idleMs or the connection closed.
+		void read(int idleMs)
+		{
+			char buffer[4096];
+			int r;
+			while ((r = listener.receive(buffer, sizeof(buffer), idleMs)) > 0) {
+				for (int i = 0; i < r; ++i)
+					decode(buffer[i]);
+			}
+			if (r < 0)
+				reset();
+		}
+
+		void reset()
+		{
+			frame.clear();
+			escaped = false;
+		}
+
+		void decode(char c)
+		{
+			if (c == SlipEnd) {
+				if (!frame.empty())
+					packet();
+				reset();
+			}
+			else if (escaped) {
+				frame.push_back(c == SlipEscEnd ? SlipEnd : c == SlipEscEsc ? SlipEsc : c);
+				escaped = false;
+			}
+			else if (c == SlipEsc) {
+				escaped = true;
+			}
+			else {
+				frame.push_back(c);
+			}
+		}
+
+		void packet()
+		{
+			uint32_t sequence = 0;
+			if (frame.size() >= 5)
+				std::memcpy(&sequence, frame.data(), 4);
+
+			std::string expected;
+			makeTestPacket(sequence, frame.size() >= 5 && frame[4], expected);
+			if (frame != expected) {
+				malformed++;
+				return;
+			}
+
+			if (static_cast<int64_t>(sequence) <= lastSequence)
+				reordered++;
+			lastSequence = sequence;
+
+			received++;
+			if (frame[4])
+				critical++;
+		}
+	};
+}
+
+bool runOscTcpTest(int port)
+{
+	using namespace std::chrono_literals;
+
+	TcpReader reader;
+	if (!reader.listener.listen(port, 4096)) {
+		ofLogError() << "TCP test: cannot listen on port " << port << ".";
+		return false;
+	}
+
+	WiimoOscTcpTransport transport;
+	transport.setup("127.0.0.1", port, 16 * 1024);
+
+	uint32_t sequence = 0;
+	uint64_t criticalQueued = 0;
+	std::string packet;
+	const auto enqueue = [&](bool critical) {
+		makeTestPacket(sequence++, critical, packet);
+		criticalQueued += critical;
+		transport.enqueue(packet.data(), packet.size(), critical);
+	};
+
+	// Runs the sender and the reader until the sender has nothing left or the time is up.
+	const auto pump = [&](std::chrono::milliseconds limit) {
+		const auto end = WiimoOscTcpTransport::Clock::now() + limit;
+		while (WiimoOscTcpTransport::Clock::now() < end) {
+			transport.flush();
+			if (!reader.listener.isConnected())
+				reader.listener.accept(5);
+			else
+				reader.read(5);
+
+			const auto & s = transport.stats();
+			if (transport.isConnected() && s.packetsSent + s.droppedContinuous + s.droppedCritical == sequence)
+				break;
+		}
+		reader.read(50);
+	};
+
+	bool passed = true;
+	const auto check = [&](const char * step) {
+		const auto & s = transport.stats();
+		const bool ok = reader.malformed == 0 && reader.reordered == 0
+			&& reader.received == s.packetsSent
+			&& reader.received + s.droppedContinuous + s.droppedCritical == sequence
+			&& reader.critical + s.droppedCritical == criticalQueued;
+
+		ofLogNotice() << "TCP test, " << step << ": " << sequence << " queued, " << reader.received << " received ("
+			<< reader.critical << " of " << criticalQueued << " critical), sent " << s.packetsSent << ", dropped "
+			<< s.droppedContinuous << "/" << s.droppedCritical << ", reordered " << reader.reordered
+			<< ", malformed " << reader.malformed << ", reconnects " << s.reconnects;
+		if (!ok)
+			ofLogError() << "TCP test, " << step << ": packets lost, duplicated or miscounted.";
+		passed &= ok;
+	};
+
+	// 1. Everything arrives, in order.
+	pump(2000ms);
+	for (int frame = 0; frame < 20; ++frame) {
+		for (int i = 0; i < 10; ++i)
+			enqueue(false);
+		enqueue(true);
+		pump(100ms);
+	}
+	check("in order");
+
+	// 2. The reader stalls: continuous packets are dropped, critical ones kept.
+	for (int frame = 0; frame < 5000 && transport.stats().droppedContinuous < 500; ++frame) {
+		for (int i = 0; i < 20; ++i)
+			enqueue(false);
+		enqueue(true);
+		transport.flush();
+	}
+	if (transport.stats().droppedContinuous == 0 || transport.stats().droppedCritical != 0) {
+		ofLogError() << "TCP test, stalled reader: continuous packets should be dropped before critical ones.";
+		passed = false;
+	}
+
+	// 3. The connection is reset while a write is pending. The reader first
+	// takes what already reached it, so that only the transport's own loss
+	// (at most the packet it was writing) is left to account for.
+	reader.read(100);
+	reader.listener.disconnect(true);
+	reader.reset();
+	pump(3000ms);
+	check("stalled and reset");
+
+	if (transport.stats().droppedCritical > 1 || transport.stats().reconnects == 0) {
+		ofLogError() << "TCP test: expected a reconnect, losing at most the partially written packet.";
+		passed = false;
+	}
+
+	if (passed)
+		ofLogNotice() << "TCP test passed.";
+	else
+		ofLogError() << "TCP test failed.";
+	return passed;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Socket.h"
+
+/**
+ *	OSC 1.1 stream transport: packets are SLIP-framed (RFC 1055, with an END
+ *	byte on both sides) and sent over a TCP connection with TCP_NODELAY.
+ *
+ *	Packets queued between two flush() calls are written with a single send.
+ *	The queue is bounded; when it overflows, continuous packets (orientation,
+ *	joystick, ...) are dropped before critical ones (button transitions).
+ *	Lost connections are re-established with exponential backoff. Packets
+ *	not yet written are delivered after reconnecting; only one that was
+ *	partially written when the connection broke is lost (and counted).
+ */
+class WiimoOscTcpTransport
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats
+	{
+		uint64_t packetsSent = 0; // Completely written to the socket.
+		uint64_t bytesSent = 0;
+		uint64_t droppedContinuous = 0;
+		uint64_t droppedCritical = 0;
+		uint64_t reconnects = 0;
+	};
+
+	WiimoOscTcpTransport();
+
+	bool setup(const std::string & host, int port, size_t maxQueuedBytes = 64 * 1024);
+	void close();
+
+	bool isEnabled() const { return mPort != 0; }
+	bool isConnected() const { return mSocket.state() == Net::TcpSocket::StateConnected; }
+
+	// Queues one OSC packet; critical packets are the last to be dropped.
+	bool enqueue(const char * packet, size_t size, bool critical);
+
+	// Drives reconnection and writes everything queued so far.
+	void flush();
+
+	const Stats & stats() const { return mStats; }
+
+	static void slipEncode(const char * data, size_t size, std::string & out);
+
+private:
+	struct Packet
+	{
+		std::string bytes; // SLIP-encoded
+		bool critical = false;
+	};
+
+	void connect();
+	void dropForSpace(size_t needed, bool critical);
+	void releasePacket(Packet & packet);
+	void discardPartialPacket();
+
+	Net::TcpSocket mSocket;
+	std::string mHost;
+	int mPort = 0;
+
+	std::deque<Packet> mQueue;
+	std::vector<std::string> mSpare;
+	size_t mQueuedBytes = 0;
+	size_t mMaxQueuedBytes = 0;
+
+	// Bytes already committed to the stream; they must go out before anything else.
+	std::string mWriteBuffer;
+	size_t mWriteOffset = 0;
+
+	// Packets in mWriteBuffer, by end offset; the first mWrittenPackets are out.
+	struct Written
+	{
+		size_t end = 0;
+		bool critical = false;
+	};
+	std::vector<Written> mWritten;
+	size_t mWrittenPackets = 0;
+
+	Clock::time_point mNextAttempt;
+	std::chrono::milliseconds mBackoff{ 0 };
+	bool mWasConnected = false;
+
+	Stats mStats;
+};
+
+// Sends numbered packets through the transport to a listener on the loopback
+// interface and checks delivery, ordering and drop accounting: in order,
+// with a stalled reader, and across a connection reset. Returns false on any
+// lost, duplicated, reordered or miscounted packet.
+bool runOscTcpTest(int port);
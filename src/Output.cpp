@@ -5,8 +5,16 @@
 WiimoOscOutput::WiimoOscOutput() {
 }
 
-bool WiimoOscOutput::setup(const std::string & host, int port)
+bool WiimoOscOutput::setup(const std::string & host, int port, OscTransport transport)
 {
+	mTransport = transport;
+
+	if (transport == OscTransportTcp) {
+		return mTcp.setup(host, port);
+	}
+
+	mTcp.close();
+
 	if (mSender.getHost() == host && mSender.getPort() == port && mSender.isReady())
 		return true;
 
@@ -18,9 +26,24 @@ bool WiimoOscOutput::setup(const std::string & host, int port)
 	return r;
 }
 
+bool WiimoOscOutput::isReady() const
+{
+	return mTransport == OscTransportTcp ? mTcp.isEnabled() : mSender.isReady();
+}
+
+void WiimoOscOutput::flush()
+{
+	WIIMO_TRACE_ZONE("osc flush");
+
+	if (mTransport == OscTransportTcp)
+		mTcp.flush();
+}
+
 bool WiimoOscOutput::processControllerEvents(const Wiimote::ControllerEvents & events)
 {
-	if (!mSender.isReady())
+	WIIMO_TRACE_ZONE("osc output");
+
+	if (!isReady())
 		return false;
 
 	const auto makePrefix = [](int id) {
@@ -28,10 +51,17 @@ bool WiimoOscOutput::processControllerEvents(const Wiimote::ControllerEvents & e
 		return "/wiimo/"s + std::to_string(id);
 	};
 
-	for (int i = 0; i < Wiimote::MoteButtonEnd; ++i) {
-		if (auto t = events.moteButtonTransitions[i]; t != Wiimote::TransitionNone) {
-			send(makePrefix(events.id) + "/mote/button/" + std::to_string(i), static_cast<bool>(t == Wiimote::TransitionPressed));
-		}
+	events.forEachButtonTransition([&](Wiimote::MoteButton b, Wiimote::Transition t) {
+		sendCritical(makePrefix(events.id) + "/mote/button/" + std::to_string(b), static_cast<bool>(t == Wiimote::TransitionPressed));
+	});
+
+	if (!mMapping.empty()) {
+		mMapping.evaluate(events, [this](const std::string & address, float value) {
+			send(address, value);
+		});
+
+		if (!mMapping.sendsDefaults())
+			return true;
 	}
 
 	if (events.moteOrientation) {
@@ -39,11 +69,21 @@ bool WiimoOscOutput::processControllerEvents(const Wiimote::ControllerEvents & e
 		send(makePrefix(events.id) + "/mote/rpy", rpy.roll, rpy.pitch, rpy.yaw);
 	}
 
+	if (events.predictedMoteOrientation) {
+		auto & rpy = *events.predictedMoteOrientation;
+		send(makePrefix(events.id) + "/mote/rpy/predicted", rpy.roll, rpy.pitch, rpy.yaw);
+	}
+
 	if (events.chuckJoystick) {
 		auto & joy = *events.chuckJoystick;
 		send(makePrefix(events.id) + "/chuck/joy", joy.angle, joy.magni, joy.x, joy.y);
 	}
 
+	if (events.predictedChuckJoystick) {
+		auto & joy = *events.predictedChuckJoystick;
+		send(makePrefix(events.id) + "/chuck/joy/predicted", joy.angle, joy.magni, joy.x, joy.y);
+	}
+
 	if (events.balanceBoard) {
 		auto & b = *events.balanceBoard;
 		send(makePrefix(events.id) + "/board/xy", b.x, b.y);
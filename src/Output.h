@@ -1,13 +1,50 @@
 #include <ofxOsc.h>
 #include <ofxMidi.h>
 
+#include "osc/OscOutboundPacketStream.h"
+
+#include <array>
+#include <cstdint>
 #include <type_traits>
 
 #include "WiimoteManager.h"
+#include "OscTcpTransport.h"
+#include "Mapping.h"
+#include "Trace.h"
+
+enum OscTransport
+{
+	OscTransportUdp,
+	OscTransportTcp,
+};
 
 class WiimoOscOutput
 {
 	ofxOscSender mSender;
+	WiimoOscTcpTransport mTcp;
+	OscTransport mTransport = OscTransportUdp;
+
+	std::array<char, 1024> mPacketBuffer;
+
+	WiimoMapping mMapping;
+
+	uint64_t mBytesSent = 0;
+	uint64_t mMessagesSent = 0;
+	uint64_t mSendFailures = 0;
+
+	// Size of the encoded message: padded address and type tags, then 4 bytes per non-bool argument.
+	static size_t encodedSize(const ofxOscMessage& msg)
+	{
+		const auto pad4 = [](size_t n) { return (n + 3) & ~size_t(3); };
+
+		size_t size = pad4(msg.getAddress().size() + 1) + pad4(msg.getNumArgs() + 2);
+		for (size_t i = 0; i < msg.getNumArgs(); ++i) {
+			auto t = msg.getArgType(i);
+			if (t != OFXOSC_TYPE_TRUE && t != OFXOSC_TYPE_FALSE)
+				size += 4;
+		}
+		return size;
+	}
 
 	template <typename Arg>
 	void makeMessage(ofxOscMessage& msg, Arg&& arg)
@@ -35,18 +72,99 @@ class WiimoOscOutput
 		makeMessage(msg, std::forward<Args>(args)...);
 	}
 
+	template <typename Arg>
+	void appendArg(osc::OutboundPacketStream& packet, Arg&& arg)
+	{
+		using T = std::decay_t<Arg>;
+
+		if constexpr (std::is_same<T, bool>::value) {
+			packet << static_cast<bool>(arg);
+		}
+		else if constexpr (std::is_integral<T>::value) {
+			packet << static_cast<osc::int32>(arg);
+		}
+		else if constexpr (std::is_floating_point<T>::value) {
+			packet << static_cast<float>(arg);
+		}
+		else {
+			static_assert(std::is_same_v<int, bool>, "WiimoOscOutput::send: Unhandled argument type.");
+		}
+	}
+
+	// Sends a continuous value; over TCP it may be dropped under backpressure.
 	template <typename... Args>
 	bool send(const std::string& addr, Args &&... args)
 	{
+		return sendPacket(false, addr, std::forward<Args>(args)...);
+	}
+
+	// Sends a state transition (e.g. a button press) that must not be lost.
+	template <typename... Args>
+	bool sendCritical(const std::string& addr, Args &&... args)
+	{
+		return sendPacket(true, addr, std::forward<Args>(args)...);
+	}
+
+	template <typename... Args>
+	bool sendPacket(bool critical, const std::string& addr, Args &&... args)
+	{
+		WIIMO_TRACE_ZONE("osc send");
+
+		if (mTransport == OscTransportTcp) {
+			osc::OutboundPacketStream packet(mPacketBuffer.data(), mPacketBuffer.size());
+			packet << osc::BeginMessage(addr.c_str());
+			(appendArg(packet, std::forward<Args>(args)), ...);
+			packet << osc::EndMessage;
+
+			if (!mTcp.enqueue(packet.Data(), packet.Size(), critical)) {
+				mSendFailures++;
+				return false;
+			}
+
+			mBytesSent += packet.Size();
+			mMessagesSent++;
+			return true;
+		}
+
 		ofxOscMessage msg;
 		msg.setAddress(addr);
 		makeMessage(msg, std::forward<Args>(args)...);
-		return mSender.sendMessage(msg, false);
+
+		if (!mSender.sendMessage(msg, false)) {
+			mSendFailures++;
+			return false;
+		}
+
+		mBytesSent += encodedSize(msg);
+		mMessagesSent++;
+		return true;
 	}
 
 public:
+	// Streams processControllerEvents() sends.
+	static constexpr Wiimote::StreamMask Streams = Wiimote::StreamButtons | Wiimote::StreamMoteOrientation
+		| Wiimote::StreamChuckJoystick | Wiimote::StreamBalanceBoard;
+
 	WiimoOscOutput();
 
-	bool setup(const std::string & host, int port);
+	bool setup(const std::string & host, int port, OscTransport transport = OscTransportUdp);
+	bool isReady() const;
+
+	// Writes out everything queued for stream transports; call once per frame.
+	void flush();
+
+	const WiimoOscTcpTransport & tcp() const { return mTcp; }
+
+	// Loads user mappings sent along with (or instead of) the built-in messages.
+	bool loadMapping(const std::string & path) { return mMapping.load(path); }
+	const WiimoMapping & mapping() const { return mMapping; }
+
+	// Streams processControllerEvents() needs with the current mapping.
+	Wiimote::StreamMask streams() const { return Streams | mMapping.streams(); }
+
 	bool processControllerEvents(const Wiimote::ControllerEvents & events);
+
+	uint64_t bytesSent() const { return mBytesSent; }
+	uint64_t messagesSent() const { return mMessagesSent; }
+	uint64_t sendFailures() const { return mSendFailures; }
 };
@@ -0,0 +1,291 @@
+#include "Polling.h"
+#include "Trace.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace Wiimote
+{
+
+static constexpr int kMaxPollHandles = 16;
+
+Poller::Poller(const PollConfig& config)
+	: mConfig(config)
+{
+	mStart = mLastSample = Clock::now();
+	mLastEvent = Clock::time_point();
+}
+
+bool Poller::next(PollSource& source)
+{
+	auto now = Clock::now();
+
+	if (mCpuStart < 0.0) {
+		mCpuStart = threadCpuSeconds();
+	}
+
+	bool spin = mConfig.mode == PollModeSpin;
+	if (mConfig.mode == PollModeHybrid) {
+		spin = (now - mLastEvent) < mConfig.spinDuration;
+	}
+
+	if (!spin) {
+		mStats.wakeups++;
+		if (!waitReadable(source, mConfig.blockTimeout)) {
+			mStats.idleWakeups++;
+			sampleStats(Clock::now(), false);
+			return false;
+		}
+	}
+
+	mStats.polls++;
+	bool r = source.poll();
+
+	now = Clock::now();
+	if (r) {
+		mStats.events++;
+		mLastEvent = now;
+	}
+
+	sampleStats(now, false);
+	return r;
+}
+
+bool Poller::waitReadable(PollSource& source, std::chrono::microseconds timeout)
+{
+	WIIMO_TRACE_ZONE("wait readable");
+
+	std::array<PollHandle, kMaxPollHandles> handles;
+	int count = source.handles(handles.data(), kMaxPollHandles);
+
+	// Nothing to wait on: let the source's own poll() do the waiting.
+	if (count <= 0)
+		return true;
+
+	int timeoutMs = static_cast<int>(std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count()));
+
+#ifdef _WIN32
+	DWORD r = WaitForMultipleObjects(static_cast<DWORD>(count), handles.data(), FALSE, static_cast<DWORD>(timeoutMs));
+	return r != WAIT_TIMEOUT && r != WAIT_FAILED;
+#else
+	std::array<pollfd, kMaxPollHandles> fds;
+	for (int i = 0; i < count; ++i) {
+		fds[i].fd = handles[i];
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	int r = ::poll(fds.data(), static_cast<nfds_t>(count), timeoutMs);
+
+	// On errors, fall through to a regular poll so the source can report disconnections.
+	return r != 0;
+#endif
+}
+
+void Poller::sampleStats(Clock::time_point now, bool force)
+{
+	using namespace std::chrono_literals;
+
+	if (!force && now - mLastSample < 100ms)
+		return;
+
+	mLastSample = now;
+	mStats.cpuSeconds = threadCpuSeconds() - mCpuStart;
+	mStats.wallSeconds = std::chrono::duration<double>(now - mStart).count();
+
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+	mPublishedStats = mStats;
+}
+
+PollStats Poller::stats() const
+{
+	std::lock_guard<std::mutex> lock(mStatsMutex);
+	return mPublishedStats;
+}
+
+/*static*/ double Poller::threadCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		return 0.0;
+
+	auto toTicks = [](const FILETIME& ft) {
+		return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+	};
+	return static_cast<double>(toTicks(kernel) + toTicks(user)) * 1e-7;
+#else
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0.0;
+	return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+const char* pollModeName(PollMode mode)
+{
+	switch (mode) {
+	case PollModeSpin:
+		return "spin";
+	case PollModeBlock:
+		return "block";
+	case PollModeHybrid:
+		return "hybrid";
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
+bool parsePollMode(const char* name, PollMode& mode)
+{
+	for (PollMode m : { PollModeSpin, PollModeBlock, PollModeHybrid }) {
+		if (std::strcmp(name, pollModeName(m)) == 0) {
+			mode = m;
+			return true;
+		}
+	}
+	return false;
+}
+
+//==============================================================================
+//
+// Benchmark
+//
+//==============================================================================
+
+#ifndef _WIN32
+
+/**
+ *	Fake device whose "reports" are timestamps written into a pipe by a
+ *	generator thread. The read end behaves like a HID/L2CAP socket as far
+ *	as poll() is concerned, so the wake-up latency of each mode can be
+ *	measured as the time between writing a report and handling it.
+ */
+class FakePollSource : public PollSource
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	FakePollSource(double rateHz)
+	{
+		if (pipe(mPipe) != 0) {
+			mPipe[0] = mPipe[1] = -1;
+			return;
+		}
+
+		fcntl(mPipe[0], F_SETFL, fcntl(mPipe[0], F_GETFL) | O_NONBLOCK);
+
+		mLatencies.reserve(1 << 16);
+		mGenerator = std::thread([this, rateHz] {
+			auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rateHz));
+			auto next = Clock::now();
+			while (mRunning) {
+				next += period;
+				std::this_thread::sleep_until(next);
+				int64_t stamp = Clock::now().time_since_epoch().count();
+				if (write(mPipe[1], &stamp, sizeof(stamp)) != sizeof(stamp))
+					break;
+			}
+		});
+	}
+
+	~FakePollSource() override
+	{
+		mRunning = false;
+		if (mGenerator.joinable())
+			mGenerator.join();
+		if (mPipe[0] >= 0)
+			close(mPipe[0]);
+		if (mPipe[1] >= 0)
+			close(mPipe[1]);
+	}
+
+	bool poll() override
+	{
+		bool any = false;
+		int64_t stamp;
+		while (read(mPipe[0], &stamp, sizeof(stamp)) == sizeof(stamp)) {
+			auto sent = Clock::time_point(Clock::duration(stamp));
+			mLatencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+			any = true;
+		}
+		return any;
+	}
+
+	int handles(PollHandle* out, int max) override
+	{
+		if (max < 1 || mPipe[0] < 0)
+			return 0;
+		out[0] = mPipe[0];
+		return 1;
+	}
+
+	std::vector<double>& latencies() { return mLatencies; }
+
+private:
+	int mPipe[2] = { -1, -1 };
+	std::atomic<bool> mRunning{ true };
+	std::thread mGenerator;
+	std::vector<double> mLatencies;
+};
+
+void runPollBenchmark(double rateHz, std::chrono::seconds perMode)
+{
+	for (PollMode mode : { PollModeSpin, PollModeBlock, PollModeHybrid }) {
+		PollConfig config;
+		config.mode = mode;
+
+		PollStats stats;
+		std::vector<double> latencies;
+
+		// Run on a dedicated thread so the CPU time is that of the poller alone.
+		std::thread([&] {
+			Poller poller(config);
+			FakePollSource source(rateHz);
+
+			auto end = Poller::Clock::now() + perMode;
+			while (Poller::Clock::now() < end) {
+				poller.next(source);
+			}
+
+			poller.publishStats();
+			stats = poller.stats();
+			latencies.swap(source.latencies());
+		}).join();
+
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&](double p) {
+			if (latencies.empty())
+				return 0.0;
+			return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+		};
+
+		ofLogNotice() << "Poll benchmark [" << pollModeName(mode) << "] @ " << rateHz << " Hz: "
+			<< "cpu " << stats.cpuLoad() * 100.0 << "%, "
+			<< "wake-up latency p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, "
+			<< "max " << (latencies.empty() ? 0.0 : latencies.back()) << " us, "
+			<< stats.wakeups << " waits (" << stats.idleWakeups << " idle), "
+			<< latencies.size() << " reports";
+	}
+}
+
+#endif
+
+} // namespace Wiimote
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+
+namespace Wiimote
+{
+
+enum PollMode
+{
+	PollModeSpin,   // Poll continuously; lowest latency, one core fully busy.
+	PollModeBlock,  // Sleep on the device descriptors until a report arrives.
+	PollModeHybrid, // Spin for a short while after each report, then block.
+};
+
+struct PollConfig
+{
+	PollMode mode = PollModeHybrid;
+
+	// Hybrid mode: how long to keep spinning after the last report before blocking.
+	std::chrono::microseconds spinDuration{ 500 };
+
+	// Upper bound for a single blocking wait, so the worker can still notice
+	// disconnections and stop requests while all devices are quiet.
+	std::chrono::milliseconds blockTimeout{ 20 };
+};
+
+struct PollStats
+{
+	uint64_t polls = 0;       // Calls into the device source.
+	uint64_t events = 0;      // Polls that returned at least one report.
+	uint64_t wakeups = 0;     // Returns from a blocking wait.
+	uint64_t idleWakeups = 0; // Blocking waits that ended on the timeout.
+
+	double cpuSeconds = 0.0;  // CPU time consumed by the polling thread.
+	double wallSeconds = 0.0; // Wall time since the poller started.
+
+	double cpuLoad() const { return wallSeconds > 0.0 ? cpuSeconds / wallSeconds : 0.0; }
+};
+
+#ifdef _WIN32
+using PollHandle = void*;
+#else
+using PollHandle = int;
+#endif
+
+/**
+ *	A device source that can be polled and, optionally, exposes the OS
+ *	handles its reports arrive on so the poller can sleep on them.
+ */
+class PollSource
+{
+public:
+	virtual ~PollSource() = default;
+
+	// Reads whatever is pending; returns true if any report was handled.
+	virtual bool poll() = 0;
+
+	// Fills out up to max handles to wait on; returns how many were written.
+	// Returning 0 means the source cannot be waited on and will be polled instead.
+	virtual int handles(PollHandle* out, int max) = 0;
+};
+
+/**
+ *	Implements the wait strategy between two polls of a PollSource,
+ *	and keeps CPU/wake-up statistics for it.
+ */
+class Poller
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit Poller(const PollConfig& config = {});
+
+	// Waits according to the configured mode and polls the source once.
+	bool next(PollSource& source);
+
+	const PollConfig& config() const { return mConfig; }
+
+	// Thread-safe snapshot; refreshed by the polling thread a few times per second.
+	PollStats stats() const;
+
+	// Publishes the current statistics immediately. Call from the polling thread.
+	void publishStats() { sampleStats(Clock::now(), true); }
+
+private:
+	bool waitReadable(PollSource& source, std::chrono::microseconds timeout);
+	void sampleStats(Clock::time_point now, bool force);
+
+	static double threadCpuSeconds();
+
+	PollConfig mConfig;
+
+	Clock::time_point mStart;
+	Clock::time_point mLastEvent;
+	Clock::time_point mLastSample;
+	double mCpuStart = -1.0;
+
+	PollStats mStats;
+
+	mutable std::mutex mStatsMutex;
+	PollStats mPublishedStats;
+};
+
+const char* pollModeName(PollMode mode);
+
+// Parses "spin", "block" or "hybrid"; returns false for anything else.
+bool parsePollMode(const char* name, PollMode& mode);
+
+#ifndef _WIN32
+// Runs every poll mode against a pipe-driven fake device producing reports
+// at rateHz, and logs CPU load and wake-up latency for each.
+void runPollBenchmark(double rateHz, std::chrono::seconds perMode);
+#endif
+
+} // namespace Wiimote
@@ -0,0 +1,255 @@
+#include "Prediction.h"
+#include "WiimoteManager.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace Wiimote
+{
+
+// Gaps longer than this restart the filter instead of extrapolating across them.
+static constexpr double kMaxGapSeconds = 0.5;
+
+float wrapDegrees(float angle)
+{
+	angle = std::fmod(angle + 180.0f, 360.0f);
+	if (angle < 0.0f)
+		angle += 360.0f;
+	return angle - 180.0f;
+}
+
+void ChannelPredictor::configure(float processNoise, float measurementNoise, bool wrap)
+{
+	mQ = processNoise * processNoise;
+	mR = measurementNoise * measurementNoise;
+	mWrap = wrap;
+	mInitialised = false;
+}
+
+void ChannelPredictor::update(float value, double t)
+{
+	const double dt = t - mLastTime;
+
+	if (!mInitialised || dt > kMaxGapSeconds || dt < 0.0) {
+		mValue = value;
+		mRate = 0.0f;
+		mP00 = mR;
+		mP01 = 0.0f;
+		mP11 = mR * 1e4f; // rate unknown: ~100 units/s per unit of measurement noise
+		mLastTime = t;
+		mInitialised = true;
+		return;
+	}
+
+	// Predict: x = F x, P = F P F' + Q, for a white-acceleration model.
+	const float d = static_cast<float>(dt);
+	const float d2 = d * d;
+	mValue += mRate * d;
+	mP00 += d * (2.0f * mP01 + d * mP11) + mQ * d2 * d2 * 0.25f;
+	mP01 += d * mP11 + mQ * d2 * d * 0.5f;
+	mP11 += mQ * d2;
+
+	// Correct with the measurement.
+	float innovation = value - mValue;
+	if (mWrap)
+		innovation = wrapDegrees(innovation);
+
+	const float s = mP00 + mR;
+	const float k0 = mP00 / s;
+	const float k1 = mP01 / s;
+
+	mValue += k0 * innovation;
+	mRate += k1 * innovation;
+	if (mWrap)
+		mValue = wrapDegrees(mValue);
+
+	mP11 -= k1 * mP01;
+	mP00 *= 1.0f - k0;
+	mP01 *= 1.0f - k0;
+
+	mLastTime = t;
+}
+
+float ChannelPredictor::predict(double horizon) const
+{
+	float v = mValue + mRate * static_cast<float>(horizon);
+	return mWrap ? wrapDegrees(v) : v;
+}
+
+Predictor::Predictor(const PredictionConfig& config)
+{
+	for (auto& c : mMote)
+		c.configure(config.orientationProcessNoise, config.orientationMeasurementNoise, true);
+	for (auto& c : mChuck)
+		c.configure(config.orientationProcessNoise, config.orientationMeasurementNoise, true);
+	for (auto& c : mJoystick)
+		c.configure(config.joystickProcessNoise, config.joystickMeasurementNoise, false);
+}
+
+void Predictor::process(ControllerEvents& events, uint64_t timestampMicros, std::chrono::microseconds horizon)
+{
+	const double t = static_cast<double>(timestampMicros) * 1e-6;
+	const double h = std::chrono::duration<double>(horizon).count();
+
+	const auto predictOrientation = [&](ChannelPredictor (&c)[3], const Orientation& raw) {
+		c[0].update(raw.roll, t);
+		c[1].update(raw.pitch, t);
+		c[2].update(raw.yaw, t);
+
+		Orientation rpy;
+		rpy.roll = c[0].predict(h);
+		rpy.pitch = c[1].predict(h);
+		rpy.yaw = c[2].predict(h);
+		return rpy;
+	};
+
+	if (events.moteOrientation)
+		events.predictedMoteOrientation = predictOrientation(mMote, *events.moteOrientation);
+
+	if (events.chuckOrientation)
+		events.predictedChuckOrientation = predictOrientation(mChuck, *events.chuckOrientation);
+
+	if (events.chuckJoystick) {
+		mJoystick[0].update(events.chuckJoystick->x, t);
+		mJoystick[1].update(events.chuckJoystick->y, t);
+
+		// Angle and magnitude as wiiuse derives them from x/y, like the raw values.
+		events.predictedChuckJoystick = joystickFromXY(std::clamp(mJoystick[0].predict(h), -1.0f, 1.0f),
+			std::clamp(mJoystick[1].predict(h), -1.0f, 1.0f));
+	}
+}
+
+//==============================================================================
+//
+// Offline evaluation
+//
+//==============================================================================
+
+struct MotionSample
+{
+	double t = 0.0;
+	float rpy[3] = {};
+};
+
+static std::vector<MotionSample> loadMotion(const std::string& path)
+{
+	std::vector<MotionSample> samples;
+	std::ifstream file(path);
+	if (!file) {
+		ofLogError() << "Could not open motion recording '" << path << "'.";
+		return samples;
+	}
+
+	int firstId = -1;
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::stringstream ss(line);
+		int id;
+		uint64_t timestamp;
+		MotionSample s;
+		if (!(ss >> id >> timestamp >> s.rpy[0] >> s.rpy[1] >> s.rpy[2]))
+			continue;
+
+		if (firstId < 0)
+			firstId = id;
+		if (id != firstId)
+			continue;
+
+		s.t = static_cast<double>(timestamp) * 1e-6;
+		samples.push_back(s);
+	}
+
+	return samples;
+}
+
+// Sweeps and wrist turns at a ~100 Hz report rate with timing jitter and sensor noise.
+static std::vector<MotionSample> syntheticMotion()
+{
+	std::mt19937 rng(1);
+	std::normal_distribution<float> noise(0.0f, 0.5f);
+	std::uniform_real_distribution<double> jitter(-0.002, 0.002);
+
+	std::vector<MotionSample> samples;
+	const double pi2 = 2.0 * 3.14159265358979;
+	for (int i = 0; i < 6000; ++i) {
+		MotionSample s;
+		s.t = i * 0.01 + jitter(rng);
+		s.rpy[0] = static_cast<float>(60.0 * std::sin(pi2 * 0.5 * s.t) + 20.0 * std::sin(pi2 * 1.3 * s.t + 1.0)) + noise(rng);
+		s.rpy[1] = static_cast<float>(40.0 * std::sin(pi2 * 0.7 * s.t)) + noise(rng);
+		s.rpy[2] = wrapDegrees(static_cast<float>(170.0 * std::sin(pi2 * 0.2 * s.t) + 30.0)) + noise(rng);
+		samples.push_back(s);
+	}
+	return samples;
+}
+
+void runPredictionEvaluation(const std::string& path, const PredictionConfig& config)
+{
+	std::vector<MotionSample> samples = path.empty() ? syntheticMotion() : loadMotion(path);
+	if (samples.size() < 100) {
+		ofLogError() << "Prediction evaluation needs at least 100 samples, got " << samples.size() << ".";
+		return;
+	}
+
+	ofLogNotice() << "Prediction evaluation on " << (path.empty() ? std::string("synthetic motion") : path) << ", "
+		<< samples.size() << " samples over " << samples.back().t - samples.front().t << " s";
+
+	for (int horizonMs = 0; horizonMs <= 100; horizonMs += 10) {
+		const double h = horizonMs * 1e-3;
+
+		ChannelPredictor axes[3];
+		for (auto& a : axes)
+			a.configure(config.orientationProcessNoise, config.orientationMeasurementNoise, true);
+
+		double holdError = 0.0;
+		double predictedError = 0.0;
+		size_t count = 0;
+		size_t j = 0;
+
+		for (size_t i = 0; i < samples.size(); ++i) {
+			const MotionSample& s = samples[i];
+			for (int a = 0; a < 3; ++a)
+				axes[a].update(s.rpy[a], s.t);
+
+			// Skip the first second while the filter settles.
+			if (s.t - samples.front().t < 1.0)
+				continue;
+
+			// Ground truth at t + h, interpolated from the recording.
+			const double target = s.t + h;
+			while (j + 1 < samples.size() && samples[j + 1].t < target)
+				++j;
+			if (j + 1 >= samples.size())
+				break;
+
+			const MotionSample& a0 = samples[j];
+			const MotionSample& a1 = samples[j + 1];
+			const float f = static_cast<float>((target - a0.t) / std::max(1e-9, a1.t - a0.t));
+
+			for (int a = 0; a < 3; ++a) {
+				float truth = wrapDegrees(a0.rpy[a] + f * wrapDegrees(a1.rpy[a] - a0.rpy[a]));
+				float hold = wrapDegrees(s.rpy[a] - truth);
+				float predicted = wrapDegrees(axes[a].predict(h) - truth);
+				holdError += hold * hold;
+				predictedError += predicted * predicted;
+			}
+			count += 3;
+		}
+
+		if (!count)
+			break;
+
+		ofLogNotice() << "  horizon " << horizonMs << " ms: rms error hold " << std::sqrt(holdError / count)
+			<< " deg, predicted " << std::sqrt(predictedError / count) << " deg";
+	}
+}
+
+} // namespace Wiimote
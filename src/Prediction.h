@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Wiimote
+{
+
+struct ControllerEvents;
+
+struct PredictionConfig
+{
+	bool enabled = false;
+
+	// How far ahead of each sample to extrapolate: the latency downstream of
+	// wiimo (Bluetooth, rendering) that should be compensated.
+	std::chrono::microseconds horizon{ 40000 };
+
+	// Also compensate the measured delay between a poll and its dispatch in
+	// Manager::update().
+	bool addDispatchLatency = true;
+
+	// Kalman noise parameters: white acceleration (units/s^2) and measurement
+	// noise (units), for orientation (degrees) and joystick (-1..1).
+	float orientationProcessNoise = 2000.0f;
+	float orientationMeasurementNoise = 1.0f;
+	float joystickProcessNoise = 20.0f;
+	float joystickMeasurementNoise = 0.02f;
+};
+
+/**
+ *	Constant-velocity Kalman filter over one scalar channel (state: value
+ *	and rate). Angles are wrapped to [-180, 180) when wrap is set.
+ */
+class ChannelPredictor
+{
+public:
+	void configure(float processNoise, float measurementNoise, bool wrap);
+	void reset() { mInitialised = false; }
+
+	// Folds in a measurement taken at time t (seconds).
+	void update(float value, double t);
+
+	// Value extrapolated horizon seconds past the last measurement.
+	float predict(double horizon) const;
+
+	float rate() const { return mRate; }
+
+private:
+	float mValue = 0.0f;
+	float mRate = 0.0f;
+	float mP00 = 0.0f, mP01 = 0.0f, mP11 = 0.0f;
+
+	float mQ = 0.0f;
+	float mR = 0.0f;
+	bool mWrap = false;
+
+	double mLastTime = 0.0;
+	bool mInitialised = false;
+};
+
+/**
+ *	Per-controller prediction stage, run on the worker thread. Fills the
+ *	predicted* fields of ControllerEvents next to the raw values, for the
+ *	streams present in the events.
+ */
+class Predictor
+{
+public:
+	explicit Predictor(const PredictionConfig& config = PredictionConfig());
+
+	void process(ControllerEvents& events, uint64_t timestampMicros, std::chrono::microseconds horizon);
+
+private:
+	ChannelPredictor mMote[3];
+	ChannelPredictor mChuck[3];
+	ChannelPredictor mJoystick[2];
+};
+
+float wrapDegrees(float angle);
+
+// Replays recorded motion (lines of "id timestamp_us roll pitch yaw", as
+// written by the app's recorder; the first controller in the file is used)
+// through the predictor and logs the prediction error against horizon,
+// next to the error of simply holding the last sample. Without a file, a
+// synthetic hand motion is used.
+void runPredictionEvaluation(const std::string& path, const PredictionConfig& config);
+
+} // namespace Wiimote
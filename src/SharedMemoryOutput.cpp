@@ -0,0 +1,98 @@
+#include "SharedMemoryOutput.h"
+
+#include "BinaryOutput.h"
+#include "Trace.h"
+
+#include "ofLog.h"
+
+#include <cstring>
+#include <new>
+
+WiimoShmOutput::WiimoShmOutput() {
+}
+
+WiimoShmOutput::~WiimoShmOutput()
+{
+	close();
+}
+
+bool WiimoShmOutput::setup(const std::string & name, uint32_t slotCount)
+{
+	close();
+
+	if (slotCount == 0 || !mMapping.create(name, WiimoShm::ringSize(slotCount))) {
+		ofLogWarning() << "SHM: Failed to create ring '" << name << "'";
+		mMapping.close();
+		return false;
+	}
+
+	std::memset(mMapping.data(), 0, mMapping.size());
+
+	mHeader = new (mMapping.data()) WiimoShm::RingHeader();
+	mHeader->version = WiimoShm::Version;
+	mHeader->slotCount = slotCount;
+	mHeader->slotSize = sizeof(WiimoShm::Slot);
+	mHeader->written.store(0, std::memory_order_relaxed);
+
+	WiimoShm::Slot * slots = WiimoShm::slots(mHeader);
+	for (uint32_t i = 0; i < slotCount; ++i) {
+		new (&slots[i]) WiimoShm::Slot();
+		slots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+
+	// Readers only attach once the magic is visible.
+	mHeader->magic.store(WiimoShm::Magic, std::memory_order_release);
+	mWritten = 0;
+
+	ofLogNotice() << "SHM: Publishing frames to '" << name << "' (" << slotCount << " slots)";
+	return true;
+}
+
+void WiimoShmOutput::close()
+{
+	if (mHeader)
+		mHeader->magic.store(0, std::memory_order_release);
+
+	mHeader = nullptr;
+	mMapping.close();
+}
+
+template <typename Encode>
+bool WiimoShmOutput::publish(Encode && encode)
+{
+	if (!mHeader)
+		return false;
+
+	const uint64_t n = mWritten;
+	WiimoShm::Slot & slot = WiimoShm::slots(mHeader)[n % mHeader->slotCount];
+
+	// Sequence lock: odd while writing, then the completed value.
+	slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.size.store(static_cast<uint32_t>(encode(static_cast<uint32_t>(n), slot.data, sizeof(slot.data))), std::memory_order_relaxed);
+
+	slot.sequence.store(2 * n + 2, std::memory_order_release);
+	mHeader->written.store(n + 1, std::memory_order_release);
+
+	mWritten = n + 1;
+	return true;
+}
+
+bool WiimoShmOutput::processEventFrame(const Wiimote::EventFrame & frame)
+{
+	WIIMO_TRACE_ZONE("shm output");
+
+	return publish([&](uint32_t sequence, uint8_t * data, size_t capacity) {
+		return WiimoBinaryOutput::encode(frame, 0, sequence, data, capacity);
+	});
+}
+
+bool WiimoShmOutput::processWireFrame(const WiimoWire::Frame & frame)
+{
+	WIIMO_TRACE_ZONE("shm output");
+
+	return publish([&](uint32_t sequence, uint8_t * data, size_t capacity) {
+		return WiimoBinaryOutput::encode(frame, sequence, data, capacity);
+	});
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "WiimoteManager.h"
+#include "WiimoShm.h"
+
+/**
+ *	Publishes every event frame into a shared-memory ring (see WiimoShm.h)
+ *	for consumers on the same host. Publishing never blocks: readers that
+ *	fall behind by more than the ring size are lapped and told so.
+ */
+class WiimoShmOutput
+{
+	WiimoShm::Mapping mMapping;
+	WiimoShm::RingHeader * mHeader = nullptr;
+
+	uint64_t mWritten = 0;
+
+public:
+	WiimoShmOutput();
+	~WiimoShmOutput();
+
+	bool setup(const std::string & name = WiimoShm::DefaultName, uint32_t slotCount = 256);
+	void close();
+	bool isReady() const { return mHeader != nullptr; }
+
+	bool processEventFrame(const Wiimote::EventFrame & frame);
+	bool processWireFrame(const WiimoWire::Frame & frame);
+
+	uint64_t framesWritten() const { return mWritten; }
+
+private:
+	template <typename Encode>
+	bool publish(Encode && encode);
+};
@@ -0,0 +1,297 @@
+#include "Smoothing.h"
+#include "WiimoteManager.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace Wiimote
+{
+
+static_assert(FilterBank::MaxControllers == MAX_WIIMOTES, "One set of lanes per wiimote slot.");
+
+// Gaps longer than this restart a controller's filters.
+static constexpr uint64_t kMaxGapMicros = 500000;
+
+SmoothingConfig::SmoothingConfig()
+{
+	setStream(StreamMoteOrientation, { 1.0f, 0.02f, 1.0f });
+	setStream(StreamChuckOrientation, { 1.0f, 0.02f, 1.0f });
+	setStream(StreamChuckJoystick, { 2.0f, 1.0f, 1.0f });
+	setStream(StreamBalanceBoard, { 1.0f, 1.0f, 1.0f });
+	channels[SmoothBoardTotal] = { 0.5f, 0.05f, 1.0f };
+}
+
+void SmoothingConfig::setStream(uint32_t stream, const OneEuroParams& params)
+{
+	const auto set = [&](int first, int last) {
+		for (int c = first; c <= last; ++c)
+			channels[c] = params;
+	};
+
+	if (stream & StreamMoteOrientation)
+		set(SmoothMoteRoll, SmoothMoteYaw);
+	if (stream & StreamChuckOrientation)
+		set(SmoothChuckRoll, SmoothChuckYaw);
+	if (stream & StreamChuckJoystick)
+		set(SmoothJoystickX, SmoothJoystickY);
+	if (stream & StreamBalanceBoard)
+		set(SmoothBoardX, SmoothBoardTotal);
+}
+
+void FilterBank::configure(const SmoothingConfig& config)
+{
+	for (int i = 0; i < Lanes; ++i) {
+		const int channel = i % SmoothChannelCount;
+		const bool used = i < MaxControllers * SmoothChannelCount;
+
+		mMinCutoff[i] = used ? config.channels[channel].minCutoff : 1.0f;
+		mBeta[i] = used ? config.channels[channel].beta : 0.0f;
+		mDCutoff[i] = used ? config.channels[channel].dCutoff : 1.0f;
+		mWrap[i] = used && channel <= SmoothChuckYaw ? 1.0f : 0.0f;
+		mDt[i] = 1.0f;
+	}
+
+	mInitialised.fill(false);
+}
+
+// Number of full turns to remove from an angle in degrees to bring it into
+// [-180, 180); valid for |angle| < 900. Uses a truncating conversion rather
+// than std::floor so the loop below vectorises without SSE4.1.
+static inline float turns(float angle)
+{
+	return static_cast<float>(static_cast<int>((angle + 900.0f) * (1.0f / 360.0f))) - 2.0f;
+}
+
+void FilterBank::run()
+{
+	constexpr float twoPi = 6.2831853f;
+
+	for (int i = 0; i < Lanes; ++i) {
+		const float dt = mDt[i];
+		const float active = mActive[i];
+
+		float delta = mInput[i] - mPrev[i];
+		delta -= mWrap[i] * 360.0f * turns(delta);
+
+		const float dx = delta / dt;
+		const float ad = 1.0f / (1.0f + 1.0f / (twoPi * mDCutoff[i] * dt));
+		const float edx = mDPrev[i] + ad * (dx - mDPrev[i]);
+
+		const float cutoff = mMinCutoff[i] + mBeta[i] * std::fabs(edx);
+		const float a = 1.0f / (1.0f + 1.0f / (twoPi * cutoff * dt));
+
+		float out = mPrev[i] + a * delta;
+		out -= mWrap[i] * 360.0f * turns(out);
+
+		// Inactive lanes (active = 0) keep their state.
+		mPrev[i] += active * (out - mPrev[i]);
+		mDPrev[i] += active * (edx - mDPrev[i]);
+	}
+}
+
+void FilterBank::process(EventFrame& frame)
+{
+	// Gather the samples of this frame into the lanes.
+	for (int c = 0; c < MaxControllers; ++c) {
+		float* input = mInput + c * SmoothChannelCount;
+		float* prev = mPrev + c * SmoothChannelCount;
+		float* dprev = mDPrev + c * SmoothChannelCount;
+		float* dt = mDt + c * SmoothChannelCount;
+		float* active = mActive + c * SmoothChannelCount;
+
+		for (int k = 0; k < SmoothChannelCount; ++k) {
+			input[k] = prev[k];
+			active[k] = 0.0f;
+			dt[k] = 1.0f;
+		}
+
+		if (!frame.controllers[c].has_value())
+			continue;
+
+		const ControllerEvents& events = *frame.controllers[c];
+		const auto set = [&](int k, float v) {
+			input[k] = v;
+			active[k] = 1.0f;
+		};
+
+		if (events.moteOrientation) {
+			set(SmoothMoteRoll, events.moteOrientation->roll);
+			set(SmoothMotePitch, events.moteOrientation->pitch);
+			set(SmoothMoteYaw, events.moteOrientation->yaw);
+		}
+		if (events.chuckOrientation) {
+			set(SmoothChuckRoll, events.chuckOrientation->roll);
+			set(SmoothChuckPitch, events.chuckOrientation->pitch);
+			set(SmoothChuckYaw, events.chuckOrientation->yaw);
+		}
+		if (events.chuckJoystick) {
+			set(SmoothJoystickX, events.chuckJoystick->x);
+			set(SmoothJoystickY, events.chuckJoystick->y);
+		}
+		if (events.balanceBoard) {
+			set(SmoothBoardX, events.balanceBoard->x);
+			set(SmoothBoardY, events.balanceBoard->y);
+			set(SmoothBoardTotal, events.balanceBoard->total);
+		}
+
+		const uint64_t elapsed = frame.timestamp - mLastTime[c];
+		if (!mInitialised[c] || elapsed > kMaxGapMicros) {
+			// Start from the current sample.
+			for (int k = 0; k < SmoothChannelCount; ++k) {
+				prev[k] = input[k];
+				dprev[k] = 0.0f;
+			}
+			mInitialised[c] = true;
+		}
+		else {
+			const float seconds = std::max(1e-4f, static_cast<float>(elapsed) * 1e-6f);
+			for (int k = 0; k < SmoothChannelCount; ++k)
+				dt[k] = seconds;
+		}
+
+		mLastTime[c] = frame.timestamp;
+	}
+
+	run();
+
+	// Scatter the filtered values back.
+	for (int c = 0; c < MaxControllers; ++c) {
+		if (!frame.controllers[c].has_value())
+			continue;
+
+		ControllerEvents& events = *frame.controllers[c];
+		const float* out = mPrev + c * SmoothChannelCount;
+
+		if (events.moteOrientation) {
+			events.moteOrientation->roll = out[SmoothMoteRoll];
+			events.moteOrientation->pitch = out[SmoothMotePitch];
+			events.moteOrientation->yaw = out[SmoothMoteYaw];
+		}
+		if (events.chuckOrientation) {
+			events.chuckOrientation->roll = out[SmoothChuckRoll];
+			events.chuckOrientation->pitch = out[SmoothChuckPitch];
+			events.chuckOrientation->yaw = out[SmoothChuckYaw];
+		}
+		if (events.chuckJoystick) {
+			*events.chuckJoystick = joystickFromXY(out[SmoothJoystickX], out[SmoothJoystickY]);
+		}
+		if (events.balanceBoard) {
+			events.balanceBoard->x = out[SmoothBoardX];
+			events.balanceBoard->y = out[SmoothBoardY];
+			events.balanceBoard->total = out[SmoothBoardTotal];
+		}
+	}
+}
+
+//==============================================================================
+//
+// Benchmark
+//
+//==============================================================================
+
+void runSmoothingBenchmark(std::chrono::seconds duration)
+{
+	using Clock = std::chrono::steady_clock;
+
+	SmoothingConfig config;
+	config.enabled = true;
+
+	FilterBank bank;
+	bank.configure(config);
+
+	std::mt19937 rng(1);
+	std::normal_distribution<float> noise(0.0f, 1.0f);
+
+	EventFrame frame;
+	uint64_t frames = 0;
+	double jitterIn = 0.0, jitterOut = 0.0;
+	float lastIn = 0.0f, lastOut = 0.0f;
+
+	auto start = Clock::now();
+	auto end = start + duration;
+	Clock::duration filtering{};
+
+	while (Clock::now() < end) {
+		// A still hand: the noise is all there is.
+		frame.timestamp = frames * 10000;
+		for (int c = 0; c < MAX_WIIMOTES; ++c) {
+			ControllerEvents events;
+			events.moteOrientation = Orientation{ 10.0f + noise(rng), 20.0f + noise(rng), noise(rng) };
+			events.chuckOrientation = Orientation{ noise(rng), noise(rng), noise(rng) };
+			events.chuckJoystick = Joystick{ 0.0f, 0.0f, 0.01f * noise(rng), 0.01f * noise(rng) };
+			events.balanceBoard = BalanceBoard{ 0.01f * noise(rng), 0.01f * noise(rng), 70.0f + 0.2f * noise(rng) };
+			frame.controllers[c] = events;
+		}
+
+		const float in = frame.controllers[0]->moteOrientation->pitch;
+
+		auto t0 = Clock::now();
+		bank.process(frame);
+		filtering += Clock::now() - t0;
+
+		const float out = frame.controllers[0]->moteOrientation->pitch;
+		if (frames > 100) {
+			jitterIn += (in - lastIn) * (in - lastIn);
+			jitterOut += (out - lastOut) * (out - lastOut);
+		}
+		lastIn = in;
+		lastOut = out;
+		frames++;
+	}
+
+	const double ns = std::chrono::duration<double, std::nano>(filtering).count() / std::max<uint64_t>(1, frames);
+	ofLogNotice() << "Smoothing benchmark: " << frames << " frames of " << MAX_WIIMOTES << " controllers ("
+		<< FilterBank::Lanes << " lanes), " << ns << " ns per frame; sample-to-sample jitter at rest "
+		<< std::sqrt(jitterIn / std::max<uint64_t>(1, frames)) << " deg raw, "
+		<< std::sqrt(jitterOut / std::max<uint64_t>(1, frames)) << " deg filtered";
+}
+
+bool runSmoothingTest()
+{
+	// Settled positions and the angles wiiuse reports for them.
+	struct Case
+	{
+		float x, y, angle;
+	};
+	const Case cases[] = { { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 90.0f }, { 0.0f, -1.0f, 180.0f }, { -1.0f, 0.0f, 270.0f },
+		{ 0.5f, 0.5f, 45.0f }, { 0.5f, -0.5f, 135.0f }, { -0.5f, -0.5f, 225.0f }, { -0.5f, 0.5f, 315.0f }, { -0.1f, 0.9f, 353.66f } };
+
+	SmoothingConfig config;
+	config.enabled = true;
+
+	bool passed = true;
+	for (const Case& c : cases) {
+		FilterBank bank;
+		bank.configure(config);
+
+		// From the center to the position, then 3 s at rest.
+		EventFrame frame;
+		for (int n = 0; n < 300; ++n) {
+			const float x = n ? c.x : 0.0f, y = n ? c.y : 0.0f;
+
+			ControllerEvents events;
+			events.chuckJoystick = joystickFromXY(x, y);
+			frame = EventFrame();
+			frame.timestamp = n * 10000;
+			frame.controllers[0] = events;
+			bank.process(frame);
+		}
+
+		const Joystick& joy = *frame.controllers[0]->chuckJoystick;
+		const float magnitude = std::sqrt(c.x * c.x + c.y * c.y);
+		if (std::fabs(joy.angle - c.angle) > 0.01f || std::fabs(joy.magni - magnitude) > 0.001f) {
+			ofLogError() << "Smoothing test: joystick at " << c.x << ", " << c.y << " settled at angle " << joy.angle
+				<< ", magnitude " << joy.magni << "; wiiuse reports " << c.angle << ", " << magnitude;
+			passed = false;
+		}
+	}
+
+	if (passed)
+		ofLogNotice() << "Smoothing test passed.";
+	return passed;
+}
+
+} // namespace Wiimote
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace Wiimote
+{
+
+struct EventFrame;
+
+// Continuous channels of one controller that the filter bank smooths.
+enum SmoothChannel
+{
+	SmoothMoteRoll,
+	SmoothMotePitch,
+	SmoothMoteYaw,
+	SmoothChuckRoll,
+	SmoothChuckPitch,
+	SmoothChuckYaw,
+	SmoothJoystickX,
+	SmoothJoystickY,
+	SmoothBoardX,
+	SmoothBoardY,
+	SmoothBoardTotal,
+
+	SmoothChannelCount
+};
+
+// One Euro filter parameters (Casiez et al.): the cutoff rises from
+// minCutoff with the signal speed scaled by beta, trading jitter at rest
+// for lag during fast motion.
+struct OneEuroParams
+{
+	float minCutoff = 1.0f; // Hz
+	float beta = 0.0f;      // per unit/s of speed
+	float dCutoff = 1.0f;   // Hz, for the speed estimate
+};
+
+struct SmoothingConfig
+{
+	bool enabled = false;
+
+	std::array<OneEuroParams, SmoothChannelCount> channels;
+
+	SmoothingConfig();
+
+	// Sets the parameters of every axis of a stream (StreamMoteOrientation,
+	// StreamChuckOrientation, StreamChuckJoystick, StreamBalanceBoard).
+	void setStream(uint32_t stream, const OneEuroParams& params);
+};
+
+/**
+ *	One Euro filters for every continuous channel of every controller, run
+ *	on the worker thread once per frame.
+ *
+ *	The filter state is stored as structure of arrays, one lane per channel
+ *	and controller, so a frame is filtered in a single branch-free loop
+ *	over all lanes that the compiler vectorises. Lanes without a new sample
+ *	in the frame keep their state.
+ */
+class FilterBank
+{
+public:
+	static constexpr int MaxControllers = 4; // MAX_WIIMOTES
+	static constexpr int Lanes = (MaxControllers * SmoothChannelCount + 7) & ~7;
+
+	void configure(const SmoothingConfig& config);
+
+	// Replaces the raw values of the frame with the filtered ones.
+	void process(EventFrame& frame);
+
+private:
+	void run();
+
+	alignas(32) float mInput[Lanes] = {};
+	alignas(32) float mPrev[Lanes] = {};
+	alignas(32) float mDPrev[Lanes] = {};
+	alignas(32) float mDt[Lanes] = {};
+	alignas(32) float mActive[Lanes] = {};
+
+	alignas(32) float mMinCutoff[Lanes] = {};
+	alignas(32) float mBeta[Lanes] = {};
+	alignas(32) float mDCutoff[Lanes] = {};
+	alignas(32) float mWrap[Lanes] = {}; // 1 for angles in degrees
+
+	std::array<uint64_t, MaxControllers> mLastTime = {};
+	std::array<bool, MaxControllers> mInitialised = {};
+};
+
+// Times the filter bank on frames with all controllers and all streams.
+void runSmoothingBenchmark(std::chrono::seconds duration);
+
+// Checks that smoothed values keep the device's conventions (joystick
+// angle and magnitude as wiiuse reports them). Returns false on a mismatch.
+bool runSmoothingTest();
+
+} // namespace Wiimote
@@ -0,0 +1,289 @@
+#include "Soak.h"
+#include "Output.h"
+#include "Socket.h"
+#include "WiimoteManager.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace
+{
+	double residentMB()
+	{
+#ifdef __linux__
+		std::ifstream statm("/proc/self/statm");
+		long pages = 0, resident = 0;
+		if (statm >> pages >> resident)
+			return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+#endif
+		return 0.0;
+	}
+
+	/**
+	 *	Receives the /wiimo/<id>/board/raw messages of the simulated device
+	 *	and tracks, per controller, which frame numbers arrived and how late.
+	 */
+	struct Listener
+	{
+		struct Track
+		{
+			bool started = false;
+			uint32_t first = 0;
+			uint32_t highest = 0;
+			std::vector<uint8_t> seen; // Indexed by frame number - first.
+		};
+
+		std::vector<Track> tracks = std::vector<Track>(Wiimote::Manager::MaxSubscriptionId + 1);
+		std::vector<uint32_t> latencies; // Microseconds.
+
+		uint64_t received = 0;
+		uint64_t duplicates = 0;
+		uint64_t reordered = 0;
+		uint64_t malformed = 0;
+
+		void run(Net::UdpSocket& socket, const std::atomic<bool>& stop)
+		{
+			std::vector<uint8_t> buffer(2048);
+			while (!stop) {
+				int size = socket.receive(buffer.data(), buffer.size(), 20);
+				if (size > 0)
+					handle(buffer.data(), static_cast<size_t>(size));
+			}
+		}
+
+		static float readFloat(const uint8_t* p)
+		{
+			uint32_t bits = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		void handle(const uint8_t* data, size_t size)
+		{
+			const uint32_t now = static_cast<uint32_t>(Wiimote::Manager::timestampMicros() & 0xFFFFFF);
+
+			static const char prefix[] = "/wiimo/";
+			static const char suffix[] = "/board/raw";
+
+			const char* address = reinterpret_cast<const char*>(data);
+			const size_t length = strnlen(address, size);
+			if (length == size || std::strncmp(address, prefix, sizeof(prefix) - 1) != 0)
+				return;
+			if (length < sizeof(suffix) || std::strcmp(address + length - (sizeof(suffix) - 1), suffix) != 0)
+				return; // Other streams.
+
+			// Address and type tags are padded to 4 bytes; then four big-endian floats.
+			const size_t tags = (length + 4) & ~size_t(3);
+			if (size < tags + 8 + 16 || std::memcmp(data + tags, ",ffff", 6) != 0) {
+				malformed++;
+				return;
+			}
+
+			const int id = std::atoi(address + sizeof(prefix) - 1);
+			if (id < 1 || id >= static_cast<int>(tracks.size())) {
+				malformed++;
+				return;
+			}
+
+			const uint32_t frame = static_cast<uint32_t>(readFloat(data + tags + 8));
+			const uint32_t sent = static_cast<uint32_t>(readFloat(data + tags + 12));
+
+			received++;
+			latencies.push_back((now - sent) & 0xFFFFFF);
+
+			Track& track = tracks[id];
+			if (!track.started) {
+				track.started = true;
+				track.first = frame;
+				track.highest = frame;
+			}
+			if (frame < track.first) {
+				reordered++;
+				return;
+			}
+
+			const size_t index = frame - track.first;
+			if (index >= track.seen.size())
+				track.seen.resize(index + 1, 0);
+
+			if (track.seen[index])
+				duplicates++;
+			else if (frame < track.highest)
+				reordered++;
+
+			track.seen[index] = 1;
+			track.highest = std::max(track.highest, frame);
+		}
+
+		// Frame numbers missing between the first and the highest received, over all controllers.
+		uint64_t lost(uint64_t& expected) const
+		{
+			uint64_t missing = 0;
+			expected = 0;
+			for (const Track& track : tracks) {
+				expected += track.seen.size();
+				missing += static_cast<uint64_t>(std::count(track.seen.begin(), track.seen.end(), 0));
+			}
+			return missing;
+		}
+
+		double percentileMillis(double p)
+		{
+			if (latencies.empty())
+				return 0.0;
+			const size_t k = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+			std::nth_element(latencies.begin(), latencies.begin() + k, latencies.end());
+			return latencies[k] / 1000.0;
+		}
+	};
+
+	bool runStep(const SoakConfig& config, int controllers, double rateHz, bool appStages)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		// Every app frame arrives as one burst of datagrams (several per
+		// controller and device frame at 1000 Hz); a default-sized buffer
+		// would drop them in the kernel before the listener runs.
+		Net::UdpSocket socket;
+		if (!socket.bind(config.port, 4 * 1024 * 1024)) {
+			ofLogError() << "Soak: cannot listen on port " << config.port << ".";
+			return false;
+		}
+
+		Listener listener;
+		listener.latencies.reserve(static_cast<size_t>(controllers * rateHz * (config.duration.count() + 1)));
+		std::atomic<bool> stop{ false };
+		std::thread receiver([&] { listener.run(socket, stop); });
+
+		WiimoOscOutput output;
+		output.setup("127.0.0.1", config.port);
+
+		Wiimote::DrainStats drain;
+		double memoryStart = 0.0, memoryEnd = 0.0, seconds = 0.0;
+		{
+			Wiimote::SimulationConfig simulation;
+			simulation.enabled = true;
+			simulation.controllers = controllers;
+			simulation.rateHz = rateHz;
+
+			Wiimote::Manager manager;
+			if (appStages)
+				config.appStages(manager);
+			manager.setSimulationConfig(simulation);
+			manager.subscribe(0, WiimoOscOutput::Streams, [&](const Wiimote::ControllerEvents& events) {
+				output.processControllerEvents(events);
+			});
+			manager.init();
+
+			const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / std::max(1.0, config.fps)));
+			const auto start = Clock::now();
+			const auto warmedUp = start + config.duration / 10;
+			bool baseline = false;
+
+			for (auto next = start; Clock::now() - start < config.duration;) {
+				manager.update();
+				output.flush();
+
+				if (!baseline && Clock::now() >= warmedUp) {
+					memoryStart = residentMB();
+					baseline = true;
+				}
+
+				next += interval;
+				std::this_thread::sleep_until(next);
+			}
+
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			drain = manager.drainStats();
+			memoryEnd = residentMB();
+		}
+
+		// Let the last datagrams arrive.
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		stop = true;
+		receiver.join();
+
+		// Frames DrainCoalesce folded into a later one never reach the output;
+		// their numbers are gaps by design, not loss.
+		const uint64_t coalesced = drain.framesMerged * static_cast<uint64_t>(controllers);
+
+		uint64_t expected = 0;
+		const uint64_t missing = listener.lost(expected);
+		const uint64_t lost = missing > coalesced ? missing - coalesced : 0;
+		const double nominal = controllers * rateHz * seconds;
+		const double delivered = nominal > 0.0 ? (listener.received + coalesced) / nominal : 0.0;
+		const double loss = expected ? static_cast<double>(lost) / static_cast<double>(expected) : 1.0;
+		const double p99 = listener.percentileMillis(0.99);
+		const double growth = memoryEnd - memoryStart;
+
+		std::ostringstream label;
+		label << "Soak " << controllers << " x " << rateHz << " Hz" << (appStages ? " (app stages)" : "");
+
+		ofLogNotice() << label.str() << ": " << listener.received / seconds << " msg/s ("
+			<< delivered * 100.0 << "% of nominal), lost " << lost << " (" << loss * 100.0 << "%), reordered " << listener.reordered
+			<< ", duplicates " << listener.duplicates << ", latency p50 " << listener.percentileMillis(0.5) << " ms, p95 "
+			<< listener.percentileMillis(0.95) << " ms, p99 " << p99 << " ms, max " << listener.percentileMillis(1.0)
+			<< " ms, backlog max " << drain.maxBacklog << ", coalesced " << drain.framesMerged << ", overflowed " << drain.framesOverflowed
+			<< ", memory " << (growth >= 0.0 ? "+" : "") << growth << " MB";
+
+		bool passed = true;
+		const auto fail = [&](const std::string& why) {
+			ofLogError() << label.str() << ": " << why;
+			passed = false;
+		};
+
+		if (delivered < config.minDeliveredRatio)
+			fail("delivered rate below budget");
+		if (loss > config.maxLossRatio)
+			fail("loss above budget");
+		if (p99 * 1000.0 > static_cast<double>(config.maxP99Latency.count()))
+			fail("p99 latency above budget");
+		if (growth > config.maxMemoryGrowthMB)
+			fail("memory growth above budget");
+		if (listener.malformed)
+			fail("malformed messages received");
+
+		return passed;
+	}
+}
+
+bool runSoak(const SoakConfig& config)
+{
+	struct Step
+	{
+		int controllers;
+		double rateHz;
+		bool appStages;
+	};
+
+	// Controller count first, then report rate up to ten times the hardware's,
+	// then the app's stages at the hardware rate and at the highest one.
+	const Step steps[] = { { 1, 100.0, false }, { 2, 100.0, false }, { MAX_WIIMOTES, 100.0, false },
+		{ MAX_WIIMOTES, 250.0, false }, { MAX_WIIMOTES, 500.0, false }, { MAX_WIIMOTES, 1000.0, false },
+		{ MAX_WIIMOTES, 100.0, true }, { MAX_WIIMOTES, 1000.0, true } };
+
+	bool passed = true;
+	for (const Step& step : steps) {
+		if (step.appStages && !config.appStages)
+			continue;
+		passed &= runStep(config, step.controllers, step.rateHz, step.appStages);
+	}
+
+	if (passed)
+		ofLogNotice() << "Soak passed.";
+	else
+		ofLogError() << "Soak failed.";
+	return passed;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+namespace Wiimote { class Manager; }
+
+struct SoakConfig
+{
+	// Length of every step (controller count and report rate).
+	std::chrono::seconds duration{ 5 };
+
+	// Rate of the simulated app loop calling Manager::update().
+	double fps = 60.0;
+
+	// Local port the OSC output sends to and the listener receives on.
+	int port = 12031;
+
+	// Budgets; a step exceeding one fails the run.
+	double minDeliveredRatio = 0.95;  // Received and coalesced frames over nominal (controllers x rate x time).
+	double maxLossRatio = 0.001;      // Frame numbers never received and not coalesced, over the range received.
+	std::chrono::microseconds maxP99Latency{ 30000 }; // Device frame to OSC receipt.
+	double maxMemoryGrowthMB = 16.0;  // Resident memory, from the end of the warm-up to the end of the step.
+
+	// Applied to the manager before init() in the last steps, so the
+	// drain mode and stages the app runs are measured too (the other steps
+	// use a bare manager). Usually ofApp::configureStages.
+	std::function<void(Wiimote::Manager&)> appStages;
+};
+
+/**
+ *	End-to-end load test without hardware: runs the worker with a scripted
+ *	device (Wiimote::SimulationConfig), the manager on a simulated app loop
+ *	and WiimoOscOutput over UDP to a listener on the loopback interface,
+ *	at increasing controller counts and report rates, then with the app's
+ *	stages (SoakConfig::appStages). Every step logs the
+ *	delivered rate, loss, reordering, latency percentiles, queue backlog
+ *	and resident memory growth.
+ *
+ *	Returns false if any step exceeds a budget of the config.
+ */
+bool runSoak(const SoakConfig& config);
@@ -0,0 +1,399 @@
+#include "Socket.h"
+
+// Winsock must come before anything pulling in windows.h.
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define WIIMO_INVALID_SOCKET INVALID_SOCKET
+#define wiimo_closesocket closesocket
+#else
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define WIIMO_INVALID_SOCKET (-1)
+#define wiimo_closesocket ::close
+#endif
+
+#include "ofLog.h"
+
+#include <cstring>
+
+namespace Net
+{
+
+bool initSockets()
+{
+#ifdef _WIN32
+	static const bool initialized = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return initialized;
+#else
+	return true;
+#endif
+}
+
+static bool setNonBlocking(SocketHandle s)
+{
+#ifdef _WIN32
+	u_long on = 1;
+	return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+	return fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
+
+UdpSocket::UdpSocket()
+	: mSocket(WIIMO_INVALID_SOCKET)
+{
+	initSockets();
+}
+
+UdpSocket::~UdpSocket()
+{
+	close();
+}
+
+bool UdpSocket::isOpen() const
+{
+	return mSocket != WIIMO_INVALID_SOCKET;
+}
+
+void UdpSocket::close()
+{
+	if (isOpen()) {
+		wiimo_closesocket(mSocket);
+		mSocket = WIIMO_INVALID_SOCKET;
+	}
+	mHost.clear();
+	mPort = 0;
+}
+
+bool UdpSocket::connect(const std::string& host, int port)
+{
+	close();
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || !result) {
+		ofLogWarning() << "UDP: Could not resolve " << host;
+		return false;
+	}
+
+	mSocket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	bool ok = isOpen() && ::connect(mSocket, result->ai_addr, static_cast<int>(result->ai_addrlen)) == 0 && setNonBlocking(mSocket);
+	freeaddrinfo(result);
+
+	if (!ok) {
+		close();
+		return false;
+	}
+
+	mHost = host;
+	mPort = port;
+	return true;
+}
+
+bool UdpSocket::bind(int port, int receiveBufferSize)
+{
+	close();
+
+	mSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (!isOpen())
+		return false;
+
+	if (receiveBufferSize > 0)
+		setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&receiveBufferSize), sizeof(receiveBufferSize));
+
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(static_cast<uint16_t>(port));
+
+	if (::bind(mSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || !setNonBlocking(mSocket)) {
+		close();
+		return false;
+	}
+
+	mPort = port;
+	return true;
+}
+
+bool UdpSocket::send(const void* data, size_t size)
+{
+	if (!isOpen())
+		return false;
+
+	auto r = ::send(mSocket, static_cast<const char*>(data), static_cast<int>(size), 0);
+	return r == static_cast<decltype(r)>(size);
+}
+
+int UdpSocket::receive(void* data, size_t size, int timeoutMs)
+{
+	if (!isOpen())
+		return -1;
+
+#ifdef _WIN32
+	WSAPOLLFD pfd = { mSocket, POLLRDNORM, 0 };
+	int ready = WSAPoll(&pfd, 1, timeoutMs);
+#else
+	pollfd pfd = { mSocket, POLLIN, 0 };
+	int ready = ::poll(&pfd, 1, timeoutMs);
+#endif
+	if (ready <= 0)
+		return ready;
+
+	auto r = ::recv(mSocket, static_cast<char*>(data), static_cast<int>(size), 0);
+	return r < 0 ? -1 : static_cast<int>(r);
+}
+
+//==============================================================================
+
+static bool wouldBlock()
+{
+#ifdef _WIN32
+	int err = WSAGetLastError();
+	return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+#else
+	return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+#endif
+}
+
+TcpSocket::TcpSocket()
+	: mSocket(WIIMO_INVALID_SOCKET)
+{
+	initSockets();
+}
+
+TcpSocket::~TcpSocket()
+{
+	close();
+}
+
+void TcpSocket::close()
+{
+	if (mSocket != WIIMO_INVALID_SOCKET) {
+		wiimo_closesocket(mSocket);
+		mSocket = WIIMO_INVALID_SOCKET;
+	}
+	mState = StateClosed;
+}
+
+bool TcpSocket::connect(const std::string& host, int port)
+{
+	close();
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || !result)
+		return false;
+
+	mSocket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (mSocket == WIIMO_INVALID_SOCKET) {
+		freeaddrinfo(result);
+		return false;
+	}
+
+	int on = 1;
+	setsockopt(mSocket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+#ifdef SO_NOSIGPIPE
+	setsockopt(mSocket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+	bool ok = setNonBlocking(mSocket);
+	if (ok) {
+		int r = ::connect(mSocket, result->ai_addr, static_cast<int>(result->ai_addrlen));
+		if (r == 0)
+			mState = StateConnected;
+		else if (wouldBlock())
+			mState = StateConnecting;
+		else
+			ok = false;
+	}
+	freeaddrinfo(result);
+
+	if (!ok)
+		close();
+	return ok;
+}
+
+TcpSocket::State TcpSocket::update()
+{
+	if (mState != StateConnecting)
+		return mState;
+
+#ifdef _WIN32
+	WSAPOLLFD pfd = { mSocket, POLLWRNORM, 0 };
+	int ready = WSAPoll(&pfd, 1, 0);
+#else
+	pollfd pfd = { mSocket, POLLOUT, 0 };
+	int ready = ::poll(&pfd, 1, 0);
+#endif
+	if (ready == 0)
+		return mState;
+
+	int err = 0;
+	socklen_t len = sizeof(err);
+	if (ready < 0 || getsockopt(mSocket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &len) != 0 || err != 0) {
+		close();
+		return mState;
+	}
+
+	mState = StateConnected;
+	return mState;
+}
+
+int TcpSocket::send(const void* data, size_t size)
+{
+	if (mState != StateConnected)
+		return -1;
+
+#ifdef MSG_NOSIGNAL
+	const int flags = MSG_NOSIGNAL;
+#else
+	const int flags = 0;
+#endif
+
+	auto r = ::send(mSocket, static_cast<const char*>(data), static_cast<int>(size), flags);
+	if (r < 0) {
+		if (wouldBlock())
+			return 0;
+		close();
+		return -1;
+	}
+
+	return static_cast<int>(r);
+}
+
+//==============================================================================
+
+static int pollReadable(SocketHandle s, int timeoutMs)
+{
+#ifdef _WIN32
+	WSAPOLLFD pfd = { s, POLLRDNORM, 0 };
+	return WSAPoll(&pfd, 1, timeoutMs);
+#else
+	pollfd pfd = { s, POLLIN, 0 };
+	return ::poll(&pfd, 1, timeoutMs);
+#endif
+}
+
+TcpListener::TcpListener()
+	: mSocket(WIIMO_INVALID_SOCKET)
+	, mConnection(WIIMO_INVALID_SOCKET)
+{
+	initSockets();
+}
+
+TcpListener::~TcpListener()
+{
+	close();
+}
+
+bool TcpListener::listen(int port, int receiveBufferSize)
+{
+	close();
+
+	mSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (mSocket == WIIMO_INVALID_SOCKET)
+		return false;
+
+	int on = 1;
+	setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+
+	// Set before listen() so accepted connections inherit it (and the window it advertises).
+	if (receiveBufferSize > 0)
+		setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&receiveBufferSize), sizeof(receiveBufferSize));
+
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(static_cast<uint16_t>(port));
+
+	if (::bind(mSocket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(mSocket, 1) != 0) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void TcpListener::close()
+{
+	disconnect();
+	if (mSocket != WIIMO_INVALID_SOCKET) {
+		wiimo_closesocket(mSocket);
+		mSocket = WIIMO_INVALID_SOCKET;
+	}
+}
+
+bool TcpListener::accept(int timeoutMs)
+{
+	if (mSocket == WIIMO_INVALID_SOCKET || pollReadable(mSocket, timeoutMs) <= 0)
+		return false;
+
+	SocketHandle s = ::accept(mSocket, nullptr, nullptr);
+	if (s == WIIMO_INVALID_SOCKET)
+		return false;
+
+	disconnect();
+	mConnection = s;
+	return true;
+}
+
+void TcpListener::disconnect(bool reset)
+{
+	if (mConnection == WIIMO_INVALID_SOCKET)
+		return;
+
+	if (reset) {
+		linger l = {};
+		l.l_onoff = 1;
+		l.l_linger = 0;
+		setsockopt(mConnection, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&l), sizeof(l));
+	}
+
+	wiimo_closesocket(mConnection);
+	mConnection = WIIMO_INVALID_SOCKET;
+}
+
+bool TcpListener::isConnected() const
+{
+	return mConnection != WIIMO_INVALID_SOCKET;
+}
+
+int TcpListener::receive(void* data, size_t size, int timeoutMs)
+{
+	if (mConnection == WIIMO_INVALID_SOCKET)
+		return -1;
+
+	int ready = pollReadable(mConnection, timeoutMs);
+	if (ready <= 0)
+		return ready < 0 ? -1 : 0;
+
+	auto r = ::recv(mConnection, static_cast<char*>(data), static_cast<int>(size), 0);
+	if (r <= 0) {
+		disconnect();
+		return -1;
+	}
+	return static_cast<int>(r);
+}
+
+} // namespace Net
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Net
+{
+
+#ifdef _WIN32
+using SocketHandle = uintptr_t;
+#else
+using SocketHandle = int;
+#endif
+
+/**
+ *	Minimal non-blocking UDP socket for the binary outputs, over BSD sockets
+ *	or Winsock. Either connect() to a fixed destination and send(), or
+ *	bind() to a local port and receive().
+ */
+class UdpSocket
+{
+public:
+	UdpSocket();
+	~UdpSocket();
+
+	UdpSocket(const UdpSocket&) = delete;
+	UdpSocket& operator=(const UdpSocket&) = delete;
+
+	bool connect(const std::string& host, int port);
+
+	// receiveBufferSize in bytes (0 = system default); the OS may cap it.
+	bool bind(int port, int receiveBufferSize = 0);
+	void close();
+
+	bool isOpen() const;
+	const std::string& host() const { return mHost; }
+	int port() const { return mPort; }
+
+	// Returns false if the datagram could not be handed to the OS.
+	bool send(const void* data, size_t size);
+
+	// Waits up to timeoutMs for a datagram. Returns its size, 0 on timeout, -1 on error.
+	int receive(void* data, size_t size, int timeoutMs);
+
+private:
+	SocketHandle mSocket;
+	std::string mHost;
+	int mPort = 0;
+};
+
+/**
+ *	Non-blocking TCP client with Nagle's algorithm disabled (TCP_NODELAY).
+ *	connect() only starts connecting; update() reports when it completed.
+ */
+class TcpSocket
+{
+public:
+	enum State
+	{
+		StateClosed,
+		StateConnecting,
+		StateConnected,
+	};
+
+	TcpSocket();
+	~TcpSocket();
+
+	TcpSocket(const TcpSocket&) = delete;
+	TcpSocket& operator=(const TcpSocket&) = delete;
+
+	bool connect(const std::string& host, int port);
+	void close();
+
+	// Advances a pending connect; returns the current state.
+	State update();
+	State state() const { return mState; }
+
+	// Returns the number of bytes written (0 if the socket buffer is full),
+	// or -1 if the connection was lost, in which case the socket is closed.
+	int send(const void* data, size_t size);
+
+private:
+	SocketHandle mSocket;
+	State mState = StateClosed;
+};
+
+/**
+ *	Accepts one TCP connection at a time on a loopback port and receives
+ *	from it, for local tests of the TCP client (see runOscTcpTest()).
+ */
+class TcpListener
+{
+public:
+	TcpListener();
+	~TcpListener();
+
+	TcpListener(const TcpListener&) = delete;
+	TcpListener& operator=(const TcpListener&) = delete;
+
+	// A small receiveBufferSize (bytes, 0 = system default) makes a stalled reader fill up quickly.
+	bool listen(int port, int receiveBufferSize = 0);
+	void close();
+
+	// Waits up to timeoutMs for a connection, replacing the current one.
+	bool accept(int timeoutMs);
+
+	// Closes the accepted connection; with reset, aborts it (RST) instead of shutting it down.
+	void disconnect(bool reset = false);
+	bool isConnected() const;
+
+	// Waits up to timeoutMs for data. Returns its size, 0 on timeout, -1 once the connection closed.
+	int receive(void* data, size_t size, int timeoutMs);
+
+private:
+	SocketHandle mSocket;
+	SocketHandle mConnection;
+};
+
+// Initialises the socket library once per process (Winsock); no-op elsewhere.
+bool initSockets();
+
+} // namespace Net
@@ -0,0 +1,188 @@
+#include "ThreadConfig.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#endif
+
+namespace Wiimote
+{
+
+static bool applyAffinity(const std::vector<int>& cpus, const char* name)
+{
+	if (cpus.empty())
+		return true;
+
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (int cpu : cpus) {
+		if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+			mask |= DWORD_PTR(1) << cpu;
+	}
+
+	if (mask == 0 || SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+		ofLogWarning() << "Thread '" << name << "': could not set CPU affinity (error " << GetLastError() << ").";
+		return false;
+	}
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus) {
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	}
+
+	if (int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); err != 0) {
+		ofLogWarning() << "Thread '" << name << "': could not set CPU affinity (" << std::strerror(err) << ").";
+		return false;
+	}
+#else
+	ofLogWarning() << "Thread '" << name << "': CPU affinity is not supported on this platform.";
+	return false;
+#endif
+
+	return true;
+}
+
+static bool applyScheduling(ThreadScheduling scheduling, int priority, const char* name)
+{
+	if (scheduling == ThreadSchedulingDefault)
+		return true;
+
+#ifdef _WIN32
+	int winPriority = scheduling == ThreadSchedulingFifo ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+	if (!SetThreadPriority(GetCurrentThread(), winPriority)) {
+		ofLogWarning() << "Thread '" << name << "': could not raise priority (error " << GetLastError() << ").";
+		return false;
+	}
+#else
+	int policy = scheduling == ThreadSchedulingFifo ? SCHED_FIFO : SCHED_RR;
+
+	sched_param param;
+	std::memset(&param, 0, sizeof(param));
+	param.sched_priority = std::clamp(priority, sched_get_priority_min(policy), sched_get_priority_max(policy));
+
+	if (int err = pthread_setschedparam(pthread_self(), policy, &param); err != 0) {
+		// Typically EPERM: no CAP_SYS_NICE / RLIMIT_RTPRIO. Keep the default policy.
+		ofLogWarning() << "Thread '" << name << "': could not switch to "
+			<< (policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR") << " (" << std::strerror(err)
+			<< "), running with default scheduling.";
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+bool applyThreadConfig(const ThreadConfig& config, const char* name)
+{
+	bool affinity = applyAffinity(config.cpus, name);
+	bool scheduling = applyScheduling(config.scheduling, config.priority, name);
+
+	if (affinity && scheduling && (!config.cpus.empty() || config.scheduling != ThreadSchedulingDefault))
+		ofLogNotice() << "Thread '" << name << "': applied affinity/scheduling configuration.";
+
+	return affinity && scheduling;
+}
+
+std::vector<int> parseCpuList(const std::string& list)
+{
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string item;
+
+	while (std::getline(ss, item, ',')) {
+		auto dash = item.find('-');
+		try {
+			if (dash == std::string::npos) {
+				cpus.push_back(std::stoi(item));
+			}
+			else {
+				int first = std::stoi(item.substr(0, dash));
+				int last = std::stoi(item.substr(dash + 1));
+				for (int cpu = first; cpu <= last; ++cpu)
+					cpus.push_back(cpu);
+			}
+		}
+		catch (const std::exception&) {
+			ofLogWarning() << "Ignoring invalid CPU list entry '" << item << "'.";
+		}
+	}
+
+	return cpus;
+}
+
+//==============================================================================
+//
+// Benchmark
+//
+//==============================================================================
+
+static std::vector<double> measureJitter(const ThreadConfig* config, std::chrono::seconds duration)
+{
+	using Clock = std::chrono::steady_clock;
+	using namespace std::chrono_literals;
+
+	std::vector<double> lateness;
+	lateness.reserve(static_cast<size_t>(duration.count()) * 1000);
+
+	std::thread([&] {
+		if (config)
+			applyThreadConfig(*config, "jitter-bench");
+
+		auto next = Clock::now();
+		auto end = next + duration;
+		while (next < end) {
+			next += 1ms;
+			std::this_thread::sleep_until(next);
+			lateness.push_back(std::chrono::duration<double, std::micro>(Clock::now() - next).count());
+		}
+	}).join();
+
+	std::sort(lateness.begin(), lateness.end());
+	return lateness;
+}
+
+void runJitterBenchmark(const ThreadConfig& config, std::chrono::seconds duration)
+{
+	std::atomic<bool> loaded{ true };
+	std::vector<std::thread> load;
+
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < cores; ++i) {
+		load.emplace_back([&loaded] {
+			volatile uint64_t x = 0;
+			while (loaded.load(std::memory_order_relaxed))
+				x = x + 1;
+		});
+	}
+
+	auto report = [](const char* label, const std::vector<double>& l) {
+		auto at = [&](double p) {
+			return l.empty() ? 0.0 : l[std::min(l.size() - 1, static_cast<size_t>(p * l.size()))];
+		};
+		ofLogNotice() << "Jitter benchmark [" << label << "]: lateness p50 " << at(0.5) << " us, p99 " << at(0.99)
+			<< " us, p99.9 " << at(0.999) << " us, max " << (l.empty() ? 0.0 : l.back()) << " us";
+	};
+
+	report("default", measureJitter(nullptr, duration));
+	report("configured", measureJitter(&config, duration));
+
+	loaded = false;
+	for (auto& t : load)
+		t.join();
+}
+
+} // namespace Wiimote
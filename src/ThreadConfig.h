@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace Wiimote
+{
+
+enum ThreadScheduling
+{
+	ThreadSchedulingDefault,    // Leave the OS default policy alone.
+	ThreadSchedulingFifo,       // SCHED_FIFO (Windows: time-critical priority).
+	ThreadSchedulingRoundRobin, // SCHED_RR (Windows: highest priority).
+};
+
+struct ThreadConfig
+{
+	// Cores the thread may run on; empty leaves the affinity untouched.
+	std::vector<int> cpus;
+
+	ThreadScheduling scheduling = ThreadSchedulingDefault;
+
+	// Real-time priority for FIFO/RR, clamped to the range the OS allows.
+	int priority = 50;
+};
+
+/**
+ *	Applies the affinity and scheduling settings to the calling thread.
+ *
+ *	Each setting is applied independently; whatever the process is not
+ *	allowed to change (e.g. real-time priority without CAP_SYS_NICE) is
+ *	logged and skipped, and the thread keeps running with the defaults.
+ *	Returns true if everything requested was applied.
+ */
+bool applyThreadConfig(const ThreadConfig& config, const char* name);
+
+// Parses a core list such as "2,3" or "0-3" into ThreadConfig::cpus.
+std::vector<int> parseCpuList(const std::string& list);
+
+// Measures the wake-up jitter of a 1 kHz periodic thread while all cores
+// are loaded by busy threads, once with the default settings and once
+// with the given config, and logs the percentiles of both.
+void runJitterBenchmark(const ThreadConfig& config, std::chrono::seconds duration);
+
+} // namespace Wiimote
@@ -0,0 +1,174 @@
+#include "Trace.h"
+
+#include "ofLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trace
+{
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	/**
+	 *	Zones of one thread. Only the owning thread writes; dump() copies the
+	 *	ring and drops whatever the owner overwrote while it was copying.
+	 *	The ring is allocated with the thread's first zone, so threads that
+	 *	never record one while tracing is enabled only cost their name.
+	 */
+	struct ThreadBuffer
+	{
+		int tid = 0;
+		std::string name; // Guarded by gBuffersMutex.
+		std::atomic<uint64_t> head{ 0 }; // Number of events ever written.
+		std::atomic<Event*> events{ nullptr };
+
+		~ThreadBuffer() { delete[] events.load(std::memory_order_relaxed); }
+	};
+
+	std::mutex gBuffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> gBuffers;
+
+	thread_local ThreadBuffer* tBuffer = nullptr;
+
+	const auto gEpoch = std::chrono::steady_clock::now();
+
+	ThreadBuffer& threadBuffer()
+	{
+		if (!tBuffer) {
+			// Buffers outlive their threads, so zones of finished threads can still be dumped.
+			std::lock_guard<std::mutex> lock(gBuffersMutex);
+			gBuffers.push_back(std::make_unique<ThreadBuffer>());
+			tBuffer = gBuffers.back().get();
+			tBuffer->tid = static_cast<int>(gBuffers.size());
+		}
+		return *tBuffer;
+	}
+
+	void writeEscaped(std::ostream& out, const std::string& s)
+	{
+		for (char c : s) {
+			if (c == '"' || c == '\\')
+				out << '\\';
+			if (static_cast<unsigned char>(c) >= 0x20)
+				out << c;
+		}
+	}
+}
+
+namespace detail
+{
+	std::atomic<bool> gEnabled{ false };
+
+	uint64_t nowNanos()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gEpoch).count());
+	}
+
+	void record(const char* name, uint64_t start, uint64_t end)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		Event* events = buffer.events.load(std::memory_order_relaxed);
+		if (!events) {
+			events = new Event[BufferCapacity];
+			buffer.events.store(events, std::memory_order_release);
+		}
+
+		uint64_t head = buffer.head.load(std::memory_order_relaxed);
+		events[head % BufferCapacity] = { name, start, end };
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+}
+
+void setEnabled(bool enabled)
+{
+	detail::gEnabled.store(enabled, std::memory_order_relaxed);
+	ofLogNotice() << "Tracing " << (enabled ? "enabled." : "disabled.");
+}
+
+void setThreadName(const char* name)
+{
+	ThreadBuffer& buffer = threadBuffer();
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+	buffer.name = name;
+}
+
+bool dump(const std::string& path)
+{
+	std::ofstream out(path);
+	if (!out) {
+		ofLogError() << "Could not write trace to " << path << ".";
+		return false;
+	}
+
+	// Buffers are never freed, so the list can be written without the lock;
+	// threads registering meanwhile are not kept waiting on the file.
+	struct Thread
+	{
+		const ThreadBuffer* buffer;
+		std::string name;
+	};
+	std::vector<Thread> threads;
+	{
+		std::lock_guard<std::mutex> lock(gBuffersMutex);
+		for (const auto& buffer : gBuffers)
+			threads.push_back({ buffer.get(), buffer->name });
+	}
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	size_t count = 0;
+	std::vector<Event> events;
+
+	for (const Thread& thread : threads) {
+		const ThreadBuffer* buffer = thread.buffer;
+		out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+			<< ",\"name\":\"thread_name\",\"args\":{\"name\":\"";
+		writeEscaped(out, thread.name.empty() ? "thread " + std::to_string(buffer->tid) : thread.name);
+		out << "\"}}";
+		first = false;
+
+		// Copy, then keep only the events the owner cannot have overwritten meanwhile.
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		const Event* ring = buffer->events.load(std::memory_order_acquire);
+		if (!ring)
+			continue;
+
+		uint64_t begin = head > BufferCapacity ? head - BufferCapacity : 0;
+		events.clear();
+		for (uint64_t i = begin; i < head; ++i)
+			events.push_back(ring[i % BufferCapacity]);
+
+		// The owner may be writing slot after % BufferCapacity, which holds
+		// event after - BufferCapacity; that one is not valid either.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = buffer->head.load(std::memory_order_relaxed);
+		uint64_t valid = after >= BufferCapacity ? after - BufferCapacity + 1 : 0;
+
+		for (uint64_t i = std::max(begin, valid); i < head; ++i) {
+			const Event& e = events[i - begin];
+			out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << ",\"name\":\"";
+			writeEscaped(out, e.name);
+			out << "\",\"ts\":" << e.start / 1000 << '.' << (e.start % 1000) / 100
+				<< ",\"dur\":" << (e.end - e.start) / 1000 << '.' << ((e.end - e.start) % 1000) / 100 << '}';
+			count++;
+		}
+	}
+
+	out << "\n]}\n";
+	ofLogNotice() << "Wrote " << count << " trace zones to " << path << ".";
+	return static_cast<bool>(out);
+}
+
+} // namespace Trace
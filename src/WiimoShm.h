@@ -0,0 +1,289 @@
+#pragma once
+
+// wiimo shared-memory frame ring, version 1.
+//
+// Layout and reader library for the frames published by WiimoShmOutput.
+// Self-contained apart from WiimoWire.h, so same-host consumers can copy
+// both headers into their project.
+//
+// The ring is a named shared-memory object ("/wiimo" by default) holding a
+// header followed by slotCount fixed-size slots. Frame n is written to slot
+// n % slotCount, each slot guarded by a sequence lock:
+//
+//   - the writer sets slot.sequence to 2n + 1, writes the packet, then
+//     publishes 2n + 2 and finally bumps header.written to n + 1;
+//   - a reader that wants frame n decodes the slot in place and checks
+//     that slot.sequence read 2n + 2 both before and after. Any other
+//     value means the writer lapped it while reading.
+//
+// The writer never waits for readers; any number of readers can attach.
+// Slot payloads are WiimoWire packets; the packet of frame n carries
+// sequence number n (modulo 2^32).
+
+#include "WiimoWire.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WiimoShm
+{
+
+constexpr uint32_t Magic = 0x4D484D57; // "WMHM"
+constexpr uint32_t Version = 1;
+constexpr const char* DefaultName = "/wiimo";
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory ring needs lock-free 64-bit atomics.");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Slot layout needs plain-sized 32-bit atomics.");
+
+struct alignas(64) RingHeader
+{
+	std::atomic<uint32_t> magic;  // Set last by the writer once the ring is initialised.
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;
+
+	alignas(64) std::atomic<uint64_t> written; // Number of frames published so far.
+};
+
+struct alignas(64) Slot
+{
+	std::atomic<uint64_t> sequence; // 2n + 1 while frame n is written, 2n + 2 once complete.
+	std::atomic<uint32_t> size;     // Of the packet in data; changes under a reader like data does.
+	uint32_t reserved;
+	uint8_t data[WiimoWire::MaxPacketSize];
+};
+
+inline size_t ringSize(uint32_t slotCount)
+{
+	return sizeof(RingHeader) + static_cast<size_t>(slotCount) * sizeof(Slot);
+}
+
+inline Slot* slots(RingHeader* header)
+{
+	return reinterpret_cast<Slot*>(reinterpret_cast<uint8_t*>(header) + sizeof(RingHeader));
+}
+
+/**
+ *	A mapped shared-memory object. create() is used by the writer, open()
+ *	by readers.
+ */
+class Mapping
+{
+public:
+	Mapping() = default;
+	~Mapping() { close(); }
+
+	Mapping(const Mapping&) = delete;
+	Mapping& operator=(const Mapping&) = delete;
+
+	bool create(const std::string& name, size_t size)
+	{
+		close();
+#ifdef _WIN32
+		mHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), windowsName(name).c_str());
+		if (!mHandle)
+			return false;
+		mData = MapViewOfFile(mHandle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+		int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+		if (fd < 0)
+			return false;
+		if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+			::close(fd);
+			return false;
+		}
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		mData = data == MAP_FAILED ? nullptr : data;
+		mUnlinkOnClose = true;
+#endif
+		mName = name;
+		mSize = size;
+		return mData != nullptr;
+	}
+
+	bool open(const std::string& name)
+	{
+		close();
+#ifdef _WIN32
+		mHandle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, windowsName(name).c_str());
+		if (!mHandle)
+			return false;
+		mData = MapViewOfFile(mHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		MEMORY_BASIC_INFORMATION info;
+		if (mData && VirtualQuery(mData, &info, sizeof(info)))
+			mSize = info.RegionSize;
+#else
+		int fd = shm_open(name.c_str(), O_RDWR, 0);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RingHeader)) {
+			::close(fd);
+			return false;
+		}
+		mSize = static_cast<size_t>(st.st_size);
+		void* data = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		mData = data == MAP_FAILED ? nullptr : data;
+#endif
+		mName = name;
+		return mData != nullptr;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (mData)
+			UnmapViewOfFile(mData);
+		if (mHandle)
+			CloseHandle(mHandle);
+		mHandle = nullptr;
+#else
+		if (mData)
+			munmap(mData, mSize);
+		if (mUnlinkOnClose)
+			shm_unlink(mName.c_str());
+		mUnlinkOnClose = false;
+#endif
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	void* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+private:
+#ifdef _WIN32
+	static std::string windowsName(const std::string& name)
+	{
+		return "Local\\" + (name.size() && name[0] == '/' ? name.substr(1) : name);
+	}
+
+	HANDLE mHandle = nullptr;
+#else
+	bool mUnlinkOnClose = false;
+#endif
+	void* mData = nullptr;
+	size_t mSize = 0;
+	std::string mName;
+};
+
+enum ReadResult
+{
+	ReadOk,     // A frame was decoded.
+	ReadEmpty,  // No new frame yet.
+	ReadLapped, // The writer overtook this reader; skipped ahead to the newest frame, call next() again.
+	ReadError,  // Not attached, or the ring is not a valid wiimo ring.
+};
+
+/**
+ *	Follows the ring from the newest frame at the time of attaching.
+ *	Frames are decoded straight out of shared memory; readers never block
+ *	the writer and never wait for each other.
+ */
+class Reader
+{
+public:
+	bool open(const std::string& name = DefaultName)
+	{
+		if (!mMapping.open(name))
+			return false;
+
+		mHeader = static_cast<RingHeader*>(mMapping.data());
+		if (mHeader->magic.load(std::memory_order_acquire) != Magic || mHeader->version != Version
+			|| mMapping.size() < ringSize(mHeader->slotCount) || mHeader->slotSize != sizeof(Slot)) {
+			close();
+			return false;
+		}
+
+		mCursor = mHeader->written.load(std::memory_order_acquire);
+		return true;
+	}
+
+	void close()
+	{
+		mMapping.close();
+		mHeader = nullptr;
+	}
+
+	bool isOpen() const { return mHeader != nullptr; }
+
+	// Frames published since attaching that this reader has not consumed yet.
+	uint64_t pending() const
+	{
+		return mHeader ? mHeader->written.load(std::memory_order_acquire) - mCursor : 0;
+	}
+
+	// Total number of frames skipped because the writer lapped this reader.
+	uint64_t missed() const { return mMissed; }
+
+	ReadResult next(WiimoWire::Frame& out)
+	{
+		if (!mHeader)
+			return ReadError;
+
+		uint64_t written = mHeader->written.load(std::memory_order_acquire);
+		if (mCursor >= written)
+			return ReadEmpty;
+
+		if (written - mCursor > mHeader->slotCount) {
+			skipTo(written - 1);
+			return ReadLapped;
+		}
+
+		return readSlot(out);
+	}
+
+private:
+	void skipTo(uint64_t cursor)
+	{
+		mMissed += cursor - mCursor;
+		mCursor = cursor;
+	}
+
+	ReadResult readSlot(WiimoWire::Frame& out)
+	{
+		Slot& slot = slots(mHeader)[mCursor % mHeader->slotCount];
+		const uint64_t expected = 2 * mCursor + 2;
+
+		// Read size once: a writer lapping us may change it between a check and the decode.
+		uint64_t before = slot.sequence.load(std::memory_order_acquire);
+		const uint32_t size = slot.size.load(std::memory_order_relaxed);
+		bool ok = before == expected && size <= sizeof(slot.data) && WiimoWire::decode(slot.data, size, out);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+
+		if (!ok || after != expected) {
+			// Overwritten while reading: continue from the newest frame (or past a damaged slot).
+			skipTo(std::max(mCursor + 1, mHeader->written.load(std::memory_order_acquire) - 1));
+			return ReadLapped;
+		}
+
+		mCursor++;
+		return ReadOk;
+	}
+
+	Mapping mMapping;
+	RingHeader* mHeader = nullptr;
+	uint64_t mCursor = 0;
+	uint64_t mMissed = 0;
+};
+
+} // namespace WiimoShm
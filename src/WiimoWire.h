@@ -0,0 +1,234 @@
+#pragma once
+
+// wiimo binary wire format, version 1.
+//
+// Self-contained (no openFrameworks/wiiuse dependency): receivers can copy
+// this header into their project to decode the datagrams sent by
+// WiimoBinaryOutput, or the frames published by the shared-memory output.
+//
+// One packet carries one event frame with all controllers that reported:
+//
+//   Header (24 bytes)
+//     u32  magic       'WIMO'
+//     u8   version     1
+//     u8   reserved
+//     u16  node        sender node id, 0 for a standalone instance
+//     u32  sequence    packet sequence number, +1 per packet the sender sent
+//     u32  presence    bit (id - 1) set for every controller in the packet
+//     u64  timestamp   microseconds, sender's monotonic clock
+//
+//   Then, for every controller in ascending id order:
+//     u8   id
+//     u8   fields      FieldMote | FieldChuck | FieldJoystick | FieldBoard
+//     u16  pressed     bit b set if MoteButton b was pressed in this frame
+//     u16  released    bit b set if MoteButton b was released in this frame
+//     u16  reserved
+//     f32  mote[3]     roll, pitch, yaw                   (if FieldMote)
+//     f32  chuck[3]    roll, pitch, yaw                   (if FieldChuck)
+//     f32  joy[4]      angle, magnitude, x, y             (if FieldJoystick)
+//     f32  board[7]    x, y, total, tr, tl, br, bl        (if FieldBoard)
+//
+// All values are little-endian; floats are IEEE 754 binary32.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace WiimoWire
+{
+
+constexpr uint32_t Magic = 0x4F4D4957; // "WIMO"
+constexpr uint8_t Version = 1;
+
+constexpr size_t MaxControllers = 32;
+constexpr size_t HeaderSize = 24;
+constexpr size_t ControllerHeaderSize = 8;
+
+enum Field : uint8_t
+{
+	FieldMote     = 1 << 0,
+	FieldChuck    = 1 << 1,
+	FieldJoystick = 1 << 2,
+	FieldBoard    = 1 << 3,
+};
+
+constexpr size_t MaxControllerSize = ControllerHeaderSize + (3 + 3 + 4 + 7) * sizeof(float);
+constexpr size_t MaxPacketSize = HeaderSize + MaxControllers * MaxControllerSize;
+
+struct Controller
+{
+	uint8_t id = 0;
+	uint8_t fields = 0;
+	uint16_t pressed = 0;
+	uint16_t released = 0;
+
+	float mote[3] = {};
+	float chuck[3] = {};
+	float joystick[4] = {};
+	float board[7] = {};
+};
+
+struct Frame
+{
+	uint16_t node = 0;
+	uint32_t sequence = 0;
+	uint32_t presence = 0;
+	uint64_t timestamp = 0;
+
+	size_t count = 0;
+	Controller controllers[MaxControllers];
+};
+
+namespace detail
+{
+	// The format is little-endian, as are all platforms wiimo runs on; plain copies suffice.
+	template <typename T>
+	inline void put(uint8_t*& p, T v)
+	{
+		std::memcpy(p, &v, sizeof(T));
+		p += sizeof(T);
+	}
+
+	template <typename T>
+	inline T get(const uint8_t*& p)
+	{
+		T v;
+		std::memcpy(&v, p, sizeof(T));
+		p += sizeof(T);
+		return v;
+	}
+
+	inline size_t payloadSize(uint8_t fields)
+	{
+		return ((fields & FieldMote) ? 3 : 0) * sizeof(float)
+			+ ((fields & FieldChuck) ? 3 : 0) * sizeof(float)
+			+ ((fields & FieldJoystick) ? 4 : 0) * sizeof(float)
+			+ ((fields & FieldBoard) ? 7 : 0) * sizeof(float);
+	}
+}
+
+/**
+ *	Encodes one frame. Controllers must be added in ascending id order;
+ *	add() rejects any other. The buffer must hold at least MaxPacketSize
+ *	bytes.
+ */
+class Writer
+{
+public:
+	Writer(uint8_t* buffer, size_t capacity)
+		: mBegin(buffer)
+		, mEnd(buffer + capacity)
+		, mCursor(buffer)
+	{
+	}
+
+	void begin(uint16_t node, uint32_t sequence, uint64_t timestamp)
+	{
+		mCursor = mBegin;
+		mPresence = 0;
+		detail::put<uint32_t>(mCursor, Magic);
+		detail::put<uint8_t>(mCursor, Version);
+		detail::put<uint8_t>(mCursor, 0);
+		detail::put<uint16_t>(mCursor, node);
+		detail::put<uint32_t>(mCursor, sequence);
+		detail::put<uint32_t>(mCursor, 0); // presence, patched in finish()
+		detail::put<uint64_t>(mCursor, timestamp);
+	}
+
+	bool add(const Controller& c)
+	{
+		if (c.id == 0 || c.id > MaxControllers)
+			return false;
+		if (mPresence >> (c.id - 1)) // This id or a higher one is already in.
+			return false;
+		if (static_cast<size_t>(mEnd - mCursor) < ControllerHeaderSize + detail::payloadSize(c.fields))
+			return false;
+
+		detail::put<uint8_t>(mCursor, c.id);
+		detail::put<uint8_t>(mCursor, c.fields);
+		detail::put<uint16_t>(mCursor, c.pressed);
+		detail::put<uint16_t>(mCursor, c.released);
+		detail::put<uint16_t>(mCursor, 0);
+
+		if (c.fields & FieldMote)
+			for (float v : c.mote) detail::put<float>(mCursor, v);
+		if (c.fields & FieldChuck)
+			for (float v : c.chuck) detail::put<float>(mCursor, v);
+		if (c.fields & FieldJoystick)
+			for (float v : c.joystick) detail::put<float>(mCursor, v);
+		if (c.fields & FieldBoard)
+			for (float v : c.board) detail::put<float>(mCursor, v);
+
+		mPresence |= uint32_t(1) << (c.id - 1);
+		return true;
+	}
+
+	// Returns the packet size in bytes.
+	size_t finish()
+	{
+		uint8_t* p = mBegin + 12;
+		detail::put<uint32_t>(p, mPresence);
+		return static_cast<size_t>(mCursor - mBegin);
+	}
+
+private:
+	uint8_t* mBegin;
+	uint8_t* mEnd;
+	uint8_t* mCursor;
+	uint32_t mPresence = 0;
+};
+
+/**
+ *	Decodes a packet into out. Returns false for anything that is not a
+ *	complete, well-formed version 1 packet.
+ */
+inline bool decode(const uint8_t* data, size_t size, Frame& out)
+{
+	if (size < HeaderSize)
+		return false;
+
+	const uint8_t* p = data;
+	const uint8_t* end = data + size;
+
+	if (detail::get<uint32_t>(p) != Magic)
+		return false;
+	if (detail::get<uint8_t>(p) != Version)
+		return false;
+	detail::get<uint8_t>(p);
+
+	out.node = detail::get<uint16_t>(p);
+	out.sequence = detail::get<uint32_t>(p);
+	out.presence = detail::get<uint32_t>(p);
+	out.timestamp = detail::get<uint64_t>(p);
+	out.count = 0;
+
+	while (p < end) {
+		if (out.count >= MaxControllers || static_cast<size_t>(end - p) < ControllerHeaderSize)
+			return false;
+
+		Controller& c = out.controllers[out.count];
+		c.id = detail::get<uint8_t>(p);
+		c.fields = detail::get<uint8_t>(p);
+		c.pressed = detail::get<uint16_t>(p);
+		c.released = detail::get<uint16_t>(p);
+		detail::get<uint16_t>(p);
+
+		if (static_cast<size_t>(end - p) < detail::payloadSize(c.fields))
+			return false;
+
+		if (c.fields & FieldMote)
+			for (float& v : c.mote) v = detail::get<float>(p);
+		if (c.fields & FieldChuck)
+			for (float& v : c.chuck) v = detail::get<float>(p);
+		if (c.fields & FieldJoystick)
+			for (float& v : c.joystick) v = detail::get<float>(p);
+		if (c.fields & FieldBoard)
+			for (float& v : c.board) v = detail::get<float>(p);
+
+		out.count++;
+	}
+
+	return true;
+}
+
+} // namespace WiimoWire
@@ -1,4 +1,6 @@
 #include "WiimoteManager.h"
+#include "DeviceRegistry.h"
+#include "Trace.h"
 
 #define JUCE_CORE_INCLUDE_NATIVE_HEADERS 1
 
@@ -6,10 +8,13 @@
 
 #include "ofLog.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <thread>
 #include <map>
+#include <cstring>
 
 //==============================================================================
 //
@@ -28,12 +33,70 @@ void logVerbose(const char* fmt, Args &&... args)
 	ofLogVerbose() << buffer;
 }
 
+/**
+ *	Adapts a wiiuse device array to the Poller: polling goes through
+ *	wiiuse_poll(), and on BlueZ the L2CAP interrupt sockets of connected
+ *	devices are exposed so the poller can sleep on them.
+ */
+class WiiusePollSource : public PollSource
+{
+public:
+	WiiusePollSource(wiimote** wiimotes)
+		: mWiimotes(wiimotes)
+	{
+	}
+
+	bool poll() override
+	{
+		WIIMO_TRACE_ZONE("wiiuse_poll");
+		return wiiuse_poll(mWiimotes, MAX_WIIMOTES) > 0;
+	}
+
+	int handles(PollHandle* out, int max) override
+	{
+		int count = 0;
+#ifdef WIIUSE_BLUEZ
+		for (int i = 0; i < MAX_WIIMOTES && count < max; ++i) {
+			if (mWiimotes[i] && WIIMOTE_IS_CONNECTED(mWiimotes[i])) {
+				out[count++] = mWiimotes[i]->in_sock;
+			}
+		}
+#endif
+		// Other backends wait inside wiiuse_poll() on their own (timeout set via wiiuse_set_timeout).
+		return count;
+	}
+
+private:
+	wiimote** mWiimotes;
+};
+
+static_assert(Manager::MaxSubscriptionId == DeviceRegistry::MaxId, "Subscriptions must cover all registry ids.");
+
 class Worker 
 {
 public:
 	Worker(Manager& manager)
 		: mManager(manager)
+		, mPoller(poll_config(manager))
 	{
+		mFilterBank.configure(manager.mSmoothingConfig);
+		mPredictors.fill(Predictor(manager.mPredictionConfig));
+		mAligner.configure(manager.mAlignmentConfig);
+	}
+
+	/**
+	 *	@brief Poll settings of the manager, adjusted for alignment.
+	 *
+	 *	Aligned frames are released between two polls, so a blocking wait
+	 *	must not outlast one period of the aligned clock.
+	 */
+	static PollConfig poll_config(const Manager& manager) {
+		PollConfig config = manager.mPollConfig;
+		if (manager.mAlignmentConfig.enabled) {
+			auto period = std::chrono::milliseconds(static_cast<int>(1000.0 / std::max(1.0, manager.mAlignmentConfig.rateHz)));
+			config.blockTimeout = std::clamp(period, std::chrono::milliseconds(1), config.blockTimeout);
+		}
+		return config;
 	}
 
 	~Worker()
@@ -114,6 +177,7 @@ public:
 	 */
 	void handle_disconnect(wiimote* wm) {
 		logVerbose("\n\n--- DISCONNECTED [wiimote id %i] ---", wm->unid);
+		mAligner.reset(wm->unid - 1);
 	}
 
 	/**
@@ -125,115 +189,78 @@ public:
 	 *	event occurs on the specified wiimote.
 	 */
 	void handle_event(struct wiimote_t* wm) {
+		WIIMO_TRACE_ZONE("handle_event");
 		logVerbose("\n\n--- EVENT [id %i] ---", wm->unid);
 
-        ControllerEvents events;
-        events.id = wm->unid;
-
-        for (int b = MoteButtonBegin; b < MoteButtonEnd; ++b)
-        {
-			auto code = Manager::buttonToWiimoteCode(MoteButton(b));
+        const int slot = wm->unid - 1;
 
-			if (!code.has_value())
-				continue;
-
-            if (IS_JUST_PRESSED(wm, *code)) {
-				events.moteButtonTransitions[b] = TransitionPressed;
-                ofLogVerbose() << "Button " << b << " pressed.";
-            }
-            else if (IS_RELEASED(wm, *code)) {
-				events.moteButtonTransitions[b] = TransitionReleased;
-                ofLogVerbose() << "Button " << b << " released.";
-            }
-            else {
-				events.moteButtonTransitions[b] = TransitionNone;
-            }
-        }
-
-		/* if a button is pressed, report it */
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_A)) {
-			logVerbose("A pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_B)) {
-			logVerbose("B pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_UP)) {
-			logVerbose("UP pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_DOWN)) {
-			logVerbose("DOWN pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_LEFT)) {
-			logVerbose("LEFT pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_RIGHT)) {
-			logVerbose("RIGHT pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_MINUS)) {
-			logVerbose("MINUS pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_PLUS)) {
-			logVerbose("PLUS pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_ONE)) {
-			logVerbose("ONE pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_TWO)) {
-			logVerbose("TWO pressed");
-		}
-		if (IS_PRESSED(wm, WIIMOTE_BUTTON_HOME)) {
-			logVerbose("HOME pressed");
-		}
+		// Only extract the streams that are both in this controller's profile and subscribed to.
+		const StreamMask profile = mProfiles[slot] & mManager.subscribedStreams(mIds[slot]);
+		if (!profile)
+			return;
 
-		/*
-		 *	Pressing minus will tell the wiimote we are no longer interested in movement.
-		 *	This is useful because it saves battery power.
-		 */
-		if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_MINUS)) {
-			wiiuse_motion_sensing(wm, 0);
-		}
+        ControllerEvents events;
+        events.id = mIds[slot];
 
-		/*
-		 *	Pressing plus will tell the wiimote we are interested in movement.
-		 */
-		if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_PLUS)) {
-			wiiuse_motion_sensing(wm, 1);
-		}
+		if (profile & StreamButtons) {
+			for (int b = MoteButtonBegin; b < MoteButtonEnd; ++b)
+			{
+				auto code = Manager::buttonToWiimoteCode(MoteButton(b));
 
-		/*
-		 *	Pressing B will toggle the rumble
-		 *
-		 *	if B is pressed but is not held, toggle the rumble
-		 */
-		//if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_B)) {
-		//	wiiuse_toggle_rumble(wm);
-		//}
+				if (!code.has_value())
+					continue;
 
-		if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_UP)) {
-			wiiuse_set_ir(wm, 1);
-		}
-		if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_DOWN)) {
-			wiiuse_set_ir(wm, 0);
-		}
+				if (IS_JUST_PRESSED(wm, *code)) {
+					events.moteButtonTransitions[b] = TransitionPressed;
+					ofLogVerbose() << "Button " << b << " pressed.";
+				}
+				else if (IS_RELEASED(wm, *code)) {
+					events.moteButtonTransitions[b] = TransitionReleased;
+					ofLogVerbose() << "Button " << b << " released.";
+				}
+				else {
+					events.moteButtonTransitions[b] = TransitionNone;
+				}
+			}
 
-		/*
-		 * Motion+ support
-		 */
-		if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_ONE)) {
-			if (WIIUSE_USING_EXP(wm)) {
-				wiiuse_set_motion_plus(wm, 2);    // nunchuck pass-through
+			/* if a button is pressed, report it */
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_A)) {
+				logVerbose("A pressed");
 			}
-			else {
-				wiiuse_set_motion_plus(wm, 1);    // standalone
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_B)) {
+				logVerbose("B pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_UP)) {
+				logVerbose("UP pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_DOWN)) {
+				logVerbose("DOWN pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_LEFT)) {
+				logVerbose("LEFT pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_RIGHT)) {
+				logVerbose("RIGHT pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_MINUS)) {
+				logVerbose("MINUS pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_PLUS)) {
+				logVerbose("PLUS pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_ONE)) {
+				logVerbose("ONE pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_TWO)) {
+				logVerbose("TWO pressed");
+			}
+			if (IS_PRESSED(wm, WIIMOTE_BUTTON_HOME)) {
+				logVerbose("HOME pressed");
 			}
-		}
-
-		if (IS_JUST_PRESSED(wm, WIIMOTE_BUTTON_TWO)) {
-			wiiuse_set_motion_plus(wm, 0); // off
 		}
 
 		/* if the accelerometer is turned on then print angles */
-		if (WIIUSE_USING_ACC(wm)) {
+		if ((profile & StreamMoteOrientation) && WIIUSE_USING_ACC(wm)) {
 			logVerbose("wiimote roll  = %f [%f]", wm->orient.roll, wm->orient.a_roll);
 			logVerbose("wiimote pitch = %f [%f]", wm->orient.pitch, wm->orient.a_pitch);
 			logVerbose("wiimote yaw   = %f", wm->orient.yaw);
@@ -251,7 +278,7 @@ public:
 		 *
 		 *	Also make sure that we see at least 1 dot.
 		 */
-		if (WIIUSE_USING_IR(wm)) {
+		if ((profile & StreamIR) && WIIUSE_USING_IR(wm)) {
 			int i = 0;
 
 			/* go through each of the 4 possible IR sources */
@@ -270,7 +297,7 @@ public:
 		}
 
 		/* show events specific to supported expansions */
-		if (wm->exp.type == EXP_NUNCHUK || wm->exp.type == EXP_MOTION_PLUS_NUNCHUK) {
+		if ((profile & StreamChuck) && (wm->exp.type == EXP_NUNCHUK || wm->exp.type == EXP_MOTION_PLUS_NUNCHUK)) {
 			/* nunchuk */
 			struct nunchuk_t* nc = (nunchuk_t*)&wm->exp.nunchuk;
 
@@ -281,34 +308,38 @@ public:
 				logVerbose("Nunchuk: Z pressed");
 			}
 
-			logVerbose("nunchuk roll  = %f", nc->orient.roll);
-			logVerbose("nunchuk pitch = %f", nc->orient.pitch);
-			logVerbose("nunchuk yaw   = %f", nc->orient.yaw);
+			if (profile & StreamChuckOrientation) {
+				logVerbose("nunchuk roll  = %f", nc->orient.roll);
+				logVerbose("nunchuk pitch = %f", nc->orient.pitch);
+				logVerbose("nunchuk yaw   = %f", nc->orient.yaw);
 
-			Orientation rpy;
-			rpy.pitch = nc->orient.pitch;
-			rpy.roll = nc->orient.roll;
-			rpy.yaw = nc->orient.yaw;
-			events.chuckOrientation = rpy;
-
-			logVerbose("nunchuk joystick angle:     %f", nc->js.ang);
-			logVerbose("nunchuk joystick magnitude: %f", nc->js.mag);
-
-			logVerbose("nunchuk joystick vals:      %f, %f", nc->js.x, nc->js.y);
-			logVerbose("nunchuk joystick calibration (min, center, max): x: %i, %i, %i  y: %i, %i, %i",
-				nc->js.min.x,
-				nc->js.center.x,
-				nc->js.max.x,
-				nc->js.min.y,
-				nc->js.center.y,
-				nc->js.max.y);
-
-			Joystick joy;
-			joy.angle = nc->js.ang;
-			joy.magni = nc->js.mag;
-			joy.x = nc->js.x;
-			joy.y = nc->js.y;
-			events.chuckJoystick = joy;
+				Orientation rpy;
+				rpy.pitch = nc->orient.pitch;
+				rpy.roll = nc->orient.roll;
+				rpy.yaw = nc->orient.yaw;
+				events.chuckOrientation = rpy;
+			}
+
+			if (profile & StreamChuckJoystick) {
+				logVerbose("nunchuk joystick angle:     %f", nc->js.ang);
+				logVerbose("nunchuk joystick magnitude: %f", nc->js.mag);
+
+				logVerbose("nunchuk joystick vals:      %f, %f", nc->js.x, nc->js.y);
+				logVerbose("nunchuk joystick calibration (min, center, max): x: %i, %i, %i  y: %i, %i, %i",
+					nc->js.min.x,
+					nc->js.center.x,
+					nc->js.max.x,
+					nc->js.min.y,
+					nc->js.center.y,
+					nc->js.max.y);
+
+				Joystick joy;
+				joy.angle = nc->js.ang;
+				joy.magni = nc->js.mag;
+				joy.x = nc->js.x;
+				joy.y = nc->js.y;
+				events.chuckJoystick = joy;
+			}
 		}
 		else if (wm->exp.type == EXP_CLASSIC) {
 			/* classic controller */
@@ -403,7 +434,7 @@ public:
 			logVerbose("Guitar joystick angle:      %f", gh3->js.ang);
 			logVerbose("Guitar joystick magnitude:  %f", gh3->js.mag);
 		}
-		else if (wm->exp.type == EXP_WII_BOARD) {
+		else if ((profile & StreamBalanceBoard) && wm->exp.type == EXP_WII_BOARD) {
 			/* wii balance board */
 			struct wii_board_t* wb = (wii_board_t*)&wm->exp.wb;
 			float total = wb->tl + wb->tr + wb->bl + wb->br;
@@ -432,8 +463,236 @@ public:
 				wm->exp.mp.angle_rate_gyro.yaw);
 		}
 
-		// Stash events onto current frame
-        mEventFrame[events.id - 1] = events;
+		// Stash events onto current frame, unless nothing subscribed changed
+		if (events.streams())
+			mEventFrame.controllers[slot] = std::move(events);
+	}
+
+	/**
+	 *	@brief Runs the smoothing and prediction stages over a polled frame.
+	 *
+	 *	All controllers are smoothed in one pass of the filter bank; the
+	 *	predictors then extrapolate the smoothed values.
+	 */
+	void filter_frame() {
+		WIIMO_TRACE_ZONE("filter_frame");
+
+		if (mManager.mSmoothingConfig.enabled) {
+			mFilterBank.process(mEventFrame);
+		}
+
+		if (mManager.mPredictionConfig.enabled) {
+			auto horizon = mManager.mPredictionConfig.horizon;
+			if (mManager.mPredictionConfig.addDispatchLatency)
+				horizon += std::chrono::microseconds(mManager.mDispatchLatencyMicros.load(std::memory_order_relaxed));
+
+			for (int i = 0; i < MAX_WIIMOTES; ++i) {
+				if (mEventFrame.controllers[i].has_value())
+					mPredictors[i].process(*mEventFrame.controllers[i], mEventFrame.timestamp, horizon);
+			}
+		}
+	}
+
+	/**
+	 *	@brief Configures a wiimote for a report profile.
+	 *
+	 *	Only the sensors the profile needs are enabled, so the device uses
+	 *	the smallest report mode (e.g. buttons only, without accelerometer
+	 *	data) and handle_event() skips every stream outside of it.
+	 */
+	void apply_profile(struct wiimote_t* wm, StreamMask profile) {
+		const int slot = wm->unid - 1;
+		mProfiles[slot] = profile;
+
+		wiiuse_motion_sensing(wm, (profile & StreamMoteOrientation) ? 1 : 0);
+		wiiuse_set_ir(wm, (profile & StreamIR) ? 1 : 0);
+
+		if (!mAddresses[slot].empty()) {
+			std::lock_guard<std::mutex> lock(mManager.mIdMutex);
+			if (mRegistry.setProfile(mAddresses[slot], profile))
+				mRegistryDirty = true;
+		}
+	}
+
+	/**
+	 *	@brief Applies the commands queued through Manager::sendCommand().
+	 *
+	 *	Called from the worker thread between two polls, so wiiuse is never
+	 *	accessed concurrently.
+	 */
+	void apply_commands() {
+		{
+			std::lock_guard<std::mutex> lock(mManager.mCommandMutex);
+			if (mManager.mCommands.empty())
+				return;
+			mCommands.swap(mManager.mCommands);
+		}
+
+		for (const Command& cmd : mCommands) {
+			for (int i = 0; i < MAX_WIIMOTES; ++i) {
+				wiimote* wm = mWiimotes[i];
+				if (!wm || !WIIMOTE_IS_CONNECTED(wm))
+					continue;
+				if (cmd.id != 0 && mIds[i] != cmd.id)
+					continue;
+
+				logVerbose("Command %i = %i [wiimote id %i]", static_cast<int>(cmd.type), cmd.value, mIds[i]);
+
+				switch (cmd.type) {
+				case CommandMotion:
+					wiiuse_motion_sensing(wm, cmd.value ? 1 : 0);
+					break;
+				case CommandIR:
+					wiiuse_set_ir(wm, cmd.value ? 1 : 0);
+					break;
+				case CommandMotionPlus:
+					if (!cmd.value) {
+						wiiuse_set_motion_plus(wm, 0);            // off
+					}
+					else if (WIIUSE_USING_EXP(wm)) {
+						wiiuse_set_motion_plus(wm, 2);            // nunchuck pass-through
+					}
+					else {
+						wiiuse_set_motion_plus(wm, 1);            // standalone
+					}
+					break;
+				case CommandRumble:
+					wiiuse_rumble(wm, cmd.value ? 1 : 0);
+					break;
+				case CommandLeds:
+					wiiuse_set_leds(wm, (cmd.value & 0x0F) << 4); // bit 0 = LED 1
+					break;
+				case CommandProfile:
+					apply_profile(wm, static_cast<StreamMask>(cmd.value));
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		mCommands.clear();
+	}
+
+	/**
+	 *	@brief Fills the wiimote slots with the addresses of known controllers.
+	 *
+	 *	wiiuse_connect() connects to every slot marked as found, using its
+	 *	address, so this replaces the inquiry scan of wiiuse_find() for
+	 *	controllers that were seen before. Returns the number of slots filled.
+	 */
+	int preload_known_devices() {
+		int count = 0;
+#ifdef WIIUSE_BLUEZ
+		for (const DeviceRecord& record : mRegistry.devices()) {
+			if (count >= MAX_WIIMOTES)
+				break;
+
+			wiimote* wm = mWiimotes[count];
+			bdaddr_t addr;
+			if (str2ba(record.address.c_str(), &addr) != 0)
+				continue;
+
+			// wiiuse exposes these read-only; they are what wiiuse_find() would have filled in.
+			std::memcpy(const_cast<bdaddr_t*>(&wm->bdaddr), &addr, sizeof(addr));
+			std::strncpy(const_cast<char*>(wm->bdaddr_str), record.address.c_str(), sizeof(wm->bdaddr_str) - 1);
+			const_cast<int&>(wm->state) |= WIIMOTE_STATE_DEV_FOUND;
+			count++;
+		}
+#endif
+		return count;
+	}
+
+	/**
+	 *	@brief Loads the registry and reserves the ids of local controllers.
+	 *
+	 *	Called by Manager::init() before the worker starts, so that
+	 *	Manager::claimId() never hands out an id of a known controller.
+	 */
+	void load_registry() {
+		if (!mManager.mRegistryPath.empty())
+			mRegistry.load(mManager.mRegistryPath);
+
+		publish_local_ids();
+	}
+
+	// Requires mManager.mIdMutex.
+	void publish_local_ids() {
+		uint32_t ids = (uint32_t(1) << MAX_WIIMOTES) - 1; // Slot order, as assigned by wiiuse.
+#ifdef WIIUSE_BLUEZ
+		if (!mManager.mRegistryPath.empty()) {
+			ids = 0;
+			for (const DeviceRecord& record : mRegistry.devices())
+				ids |= uint32_t(1) << (record.id - 1);
+		}
+#endif
+		mManager.mLocalIds = ids;
+	}
+
+	/**
+	 *	@brief Gives every connected wiimote its registered id and profile.
+	 *
+	 *	Unknown controllers are added to the registry, so they keep their id
+	 *	on the next start. Without an address (non-BlueZ backends) ids follow
+	 *	the slot order, as assigned by wiiuse.
+	 */
+	void assign_ids() {
+		std::lock_guard<std::mutex> lock(mManager.mIdMutex);
+		bool changed = false;
+
+		for (int i = 0; i < MAX_WIIMOTES; ++i) {
+			mIds[i] = mWiimotes[i]->unid;
+			mAddresses[i].clear();
+
+#ifdef WIIUSE_BLUEZ
+			if (!WIIMOTE_IS_CONNECTED(mWiimotes[i]) || mManager.mRegistryPath.empty())
+				continue;
+
+			std::string address = mWiimotes[i]->bdaddr_str;
+			changed |= mRegistry.find(address) == nullptr;
+
+			const DeviceRecord& record = mRegistry.assign(address, mProfiles[i], mManager.mClaimedIds);
+			mIds[i] = record.id;
+			mProfiles[i] = record.profile;
+			mAddresses[i] = address;
+
+			logVerbose("Wiimote %s -> id %i", address.c_str(), record.id);
+#endif
+		}
+
+		if (changed) {
+			publish_local_ids();
+			mRegistryDirty = true;
+		}
+	}
+
+	/**
+	 *	@brief Writes the registry if it changed since the last call.
+	 *
+	 *	Called from the app thread (Manager::update()) and on shutdown, so
+	 *	the poll thread, which may run with real-time priority, never waits
+	 *	on file I/O. Only the copy is taken under the lock.
+	 */
+	void save_registry() {
+		if (!mRegistryDirty.exchange(false))
+			return;
+
+		DeviceRegistry registry;
+		{
+			std::lock_guard<std::mutex> lock(mManager.mIdMutex);
+			registry = mRegistry;
+		}
+		registry.save();
+	}
+
+	static int ledsForId(int id) {
+		switch (id) {
+		case 1: return WIIMOTE_LED_1;
+		case 2: return WIIMOTE_LED_2;
+		case 3: return WIIMOTE_LED_3;
+		case 4: return WIIMOTE_LED_4;
+		default: return (id & 0x0F) << 4; // binary
+		}
 	}
 
 	short any_wiimote_connected(wiimote** wm, int mWiimote) {
@@ -456,40 +715,92 @@ public:
         using namespace std::chrono_literals;
 
 		//DBG("Starting worker thread...");
+		applyThreadConfig(mManager.mWorkerThreadConfig, "wiimote-poll");
+		Trace::setThreadName("wiimote-poll");
+
+		if (mManager.mSimulationConfig.enabled) {
+			run_simulation();
+			return;
+		}
+
+		const auto startTime = std::chrono::steady_clock::now();
+
 		mWiimotes = wiiuse_init(MAX_WIIMOTES);
 		wiiuse_set_output(LOGLEVEL_DEBUG, stdout);
 
-		int found = wiiuse_find(mWiimotes, MAX_WIIMOTES, 5);
-		if (!found) {
-			("No wiimotes found.");
-			return;
+		// Known controllers first: connecting directly skips the inquiry scan.
+		int connected = 0;
+		int found = preload_known_devices();
+		if (found) {
+			connected = wiiuse_connect(mWiimotes, MAX_WIIMOTES);
+			logVerbose("Reconnected to %i of %i known wiimotes.", connected, found);
+
+			if (!connected) {
+				wiiuse_cleanup(mWiimotes, MAX_WIIMOTES);
+				mWiimotes = wiiuse_init(MAX_WIIMOTES);
+			}
 		}
 
-		int connected = wiiuse_connect(mWiimotes, MAX_WIIMOTES);
-		if (connected) {
-			logVerbose("Connected to %i wiimotes (of %i found).", connected, found);
+		// Then scan for new controllers, filling the slots that are still free.
+		if (connected < MAX_WIIMOTES) {
+			wiimote* free[MAX_WIIMOTES];
+			int slots = 0;
+			for (int i = 0; i < MAX_WIIMOTES; ++i) {
+				if (WIIMOTE_IS_CONNECTED(mWiimotes[i]))
+					continue;
+
+				// A known address that did not answer; wiiuse_connect() would retry it.
+				const_cast<int&>(mWiimotes[i]->state) &= ~WIIMOTE_STATE_DEV_FOUND;
+				free[slots++] = mWiimotes[i];
+			}
+
+			found = wiiuse_find(free, slots, 5);
+			if (found) {
+				int added = wiiuse_connect(free, slots);
+				logVerbose("Connected to %i new wiimotes (of %i found).", added, found);
+				connected += added;
+			}
 		}
-		else {
-			logVerbose("Failed to connect to any wiimote.");
+
+		if (!connected) {
+			logVerbose(found ? "Failed to connect to any wiimote." : "No wiimotes found.");
 			return;
 		}
 
-		wiiuse_set_leds(mWiimotes[0], WIIMOTE_LED_1);
-		wiiuse_set_leds(mWiimotes[1], WIIMOTE_LED_2);
-		wiiuse_set_leds(mWiimotes[2], WIIMOTE_LED_3);
-		wiiuse_set_leds(mWiimotes[3], WIIMOTE_LED_4);
-		wiiuse_rumble(mWiimotes[0], 1);
-		wiiuse_rumble(mWiimotes[1], 1);
+		assign_ids();
+
+		for (int i = 0; i < MAX_WIIMOTES; ++i) {
+			if (WIIMOTE_IS_CONNECTED(mWiimotes[i])) {
+				wiiuse_set_leds(mWiimotes[i], ledsForId(mIds[i]));
+				wiiuse_rumble(mWiimotes[i], 1);
+			}
+		}
 
         std::this_thread::sleep_for(200ms);
 
-		wiiuse_rumble(mWiimotes[0], 0);
-		wiiuse_rumble(mWiimotes[1], 0);
+		for (int i = 0; i < MAX_WIIMOTES; ++i) {
+			if (WIIMOTE_IS_CONNECTED(mWiimotes[i]))
+				wiiuse_rumble(mWiimotes[i], 0);
+		}
+
+		ofLogNotice() << "Wiimotes ready after " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << " ms.";
 
-		while (any_wiimote_connected(mWiimotes, MAX_WIIMOTES)) {
-			if (wiiuse_poll(mWiimotes, MAX_WIIMOTES)) {
+		// Sensors follow the report profile; they can be changed remotely (see Manager::sendCommand).
+		for (int i = 0; i < MAX_WIIMOTES; ++i) {
+			if (WIIMOTE_IS_CONNECTED(mWiimotes[i]))
+				apply_profile(mWiimotes[i], mProfiles[i]);
+		}
+
+		WiiusePollSource source(mWiimotes);
+		logVerbose("Polling in %s mode.", pollModeName(mPoller.config().mode));
+
+		while (!mStopRequested && any_wiimote_connected(mWiimotes, MAX_WIIMOTES)) {
+			apply_commands();
+
+			if (mPoller.next(source)) {
 				// Create a fresh frame to collect all events:
-				mEventFrame = Manager::EventFrame();
+				mEventFrame = EventFrame();
+				mEventFrame.timestamp = Manager::timestampMicros();
 
 				/*
 				 *	This happens if something happened on any wiimote.
@@ -567,18 +878,183 @@ public:
 					}
 				}
 
-				// Add frame to queue:
-				mManager.mEventMutex.lock();
-				mManager.mEvents.push_back(mEventFrame);
-				mManager.mEventMutex.unlock();
+				process_frame();
 			}
+
+			// Aligned frames are due on their own clock, whether or not this poll had reports.
+			release_aligned();
 		}
 	}
 
+	/**
+	 *	@brief Runs the stages after polling and queues the frame.
+	 *
+	 *	Frames without any controller are dropped; with alignment enabled,
+	 *	the frame goes to the aligner instead of the queue.
+	 */
+	void process_frame() {
+		bool any = false;
+		for (const auto & c : mEventFrame.controllers)
+			any |= c.has_value();
+		if (!any)
+			return;
+
+		if (mManager.mRawHistory.isEnabled())
+			mManager.mRawHistory.push(mEventFrame);
+
+		filter_frame();
+
+		if (mManager.mHistory.isEnabled())
+			mManager.mHistory.push(mEventFrame);
+
+		if (mManager.mAlignmentConfig.enabled)
+			mAligner.push(mEventFrame);
+		else
+			enqueue_frame(mEventFrame);
+	}
+
+	/**
+	 *	@brief Queues the aligned frames that are due.
+	 */
+	void release_aligned() {
+		if (!mManager.mAlignmentConfig.enabled)
+			return;
+
+		while (mAligner.next(Manager::timestampMicros(), mAlignedFrame))
+			enqueue_frame(mAlignedFrame);
+	}
+
+	/**
+	 *	@brief Hands a frame to Manager::update().
+	 *
+	 *	The queue is bounded: while the consumer is stalled, further frames
+	 *	are merged into the newest queued one, keeping the latest values and
+	 *	every button transition, instead of growing the queue.
+	 */
+	void enqueue_frame(const EventFrame& frame)
+	{
+		WIIMO_TRACE_ZONE("enqueue frame");
+		std::lock_guard<std::mutex> lock(mManager.mEventMutex);
+		auto & queue = mManager.mEvents;
+
+		if (queue.size() < mManager.mMaxQueueSize) {
+			queue.push_back(frame);
+			queue.back().sequence = mSequence++;
+			return;
+		}
+
+		EventFrame & last = queue.back();
+		last.timestamp = frame.timestamp;
+		last.alignmentErrorMicros = std::max(last.alignmentErrorMicros, frame.alignmentErrorMicros);
+
+		for (size_t i = 0; i < MAX_WIIMOTES; ++i) {
+			if (!frame.controllers[i].has_value())
+				continue;
+
+			if (last.controllers[i].has_value())
+				Manager::mergeEvents(*last.controllers[i], *frame.controllers[i]);
+			else
+				last.controllers[i] = frame.controllers[i];
+		}
+
+		mManager.mOverflowedFrames++;
+	}
+
+	/**
+	 *	@brief Runs the scripted device of SimulationConfig instead of wiiuse.
+	 *
+	 *	Frames go through the same stages as polled ones, and only carry the
+	 *	subscribed streams.
+	 */
+	void run_simulation() {
+		const SimulationConfig & sim = mManager.mSimulationConfig;
+		const int controllers = std::clamp(sim.controllers, 1, MAX_WIIMOTES);
+		const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(1.0 / std::max(1.0, sim.rateHz)));
+
+		ofLogNotice() << "Simulating " << controllers << " wiimotes at " << sim.rateHz << " Hz.";
+
+		auto next = std::chrono::steady_clock::now();
+		for (uint32_t n = 0; !mStopRequested; ++n) {
+			std::this_thread::sleep_until(next);
+			next += period;
+
+			mEventFrame = EventFrame();
+			mEventFrame.timestamp = Manager::timestampMicros();
+
+			for (int i = 0; i < controllers; ++i) {
+				const StreamMask wanted = mProfiles[i] & mManager.subscribedStreams(mIds[i]);
+
+				ControllerEvents events;
+				events.id = mIds[i];
+
+				// Smooth motion for the filters to work on...
+				if (wanted & StreamMoteOrientation) {
+					const double t = n / sim.rateHz;
+					Orientation o;
+					o.roll = static_cast<float>(45.0 * std::sin(t + i));
+					o.pitch = static_cast<float>(30.0 * std::cos(0.7 * t + i));
+					o.yaw = 0.0f;
+					events.moteOrientation = o;
+				}
+
+				// ...and the bookkeeping in channels no stage touches.
+				if (wanted & StreamBalanceBoard) {
+					BalanceBoard b;
+					b.tr = static_cast<float>(n & 0xFFFFFF);
+					b.tl = static_cast<float>(mEventFrame.timestamp & 0xFFFFFF);
+					b.br = static_cast<float>(i);
+					events.balanceBoard = b;
+				}
+
+				if ((wanted & StreamButtons) && n % 50 == 0)
+					events.moteButtonTransitions[MoteButton_A] = (n / 50) % 2 ? TransitionReleased : TransitionPressed;
+
+				if (events.streams())
+					mEventFrame.controllers[i] = std::move(events);
+			}
+
+			process_frame();
+			release_aligned();
+		}
+	}
+
+	void requestStop()
+	{
+		mStopRequested = true;
+	}
+
+	PollStats pollStats() const
+	{
+		return mPoller.stats();
+	}
+
+	AlignmentStats alignmentStats() const
+	{
+		return mAligner.stats();
+	}
+
 private:
 	Manager& mManager;
 
-	Manager::EventFrame mEventFrame;
+	Poller mPoller;
+	std::atomic<bool> mStopRequested{ false };
+
+	EventFrame mEventFrame;
+	uint32_t mSequence = 0;
+	std::vector<Command> mCommands;
+
+	FilterBank mFilterBank;
+	std::array<Predictor, MAX_WIIMOTES> mPredictors;
+	Aligner mAligner;
+	EventFrame mAlignedFrame;
+
+	std::array<StreamMask, MAX_WIIMOTES> mProfiles = { Profile::Full, Profile::Full, Profile::Full, Profile::Full };
+	std::array<int, MAX_WIIMOTES> mIds = { 1, 2, 3, 4 };
+	std::array<std::string, MAX_WIIMOTES> mAddresses;
+
+	DeviceRegistry mRegistry; // Written under mManager.mIdMutex.
+	std::atomic<bool> mRegistryDirty{ false };
 
 	wiimote** mWiimotes = nullptr;
 };
@@ -602,8 +1078,37 @@ Manager::~Manager()
 {
 	if (mWorkerThread.has_value()) {
 		//DBG("Joining worker thread...");
+		mWorker->requestStop();
 		mWorkerThread->join();
+		mWorker->save_registry();
+	}
+}
+
+PollStats Manager::pollStats() const
+{
+	return mWorker ? mWorker->pollStats() : PollStats();
+}
+
+AlignmentStats Manager::alignmentStats() const
+{
+	return mWorker ? mWorker->alignmentStats() : AlignmentStats();
+}
+
+Joystick joystickFromXY(float x, float y)
+{
+	Joystick joy;
+	joy.x = x;
+	joy.y = y;
+	joy.magni = std::sqrt(x * x + y * y);
+
+	// wiiuse's formula, which yields NaN at the center; that is 0 here.
+	if (x != 0.0f || y != 0.0f) {
+		float angle = std::atan(y / x) * 180.0f / 3.14159265f - 90.0f;
+		if (x < 0.0f)
+			angle -= 180.0f;
+		joy.angle = std::fabs(angle);
 	}
+	return joy;
 }
 
 /*static*/ std::optional<int> Manager::buttonToWiimoteCode(MoteButton button)
@@ -638,35 +1143,281 @@ Manager::~Manager()
 	return std::nullopt;
 }
 
+/*static*/ std::optional<StreamMask> Manager::profileFromName(const std::string& name)
+{
+	static const std::map<std::string, StreamMask> presets = {
+		{ "full", Profile::Full },
+		{ "buttons", Profile::Buttons },
+		{ "buttons+accel", Profile::ButtonsAccel },
+		{ "nunchuk", Profile::Nunchuk },
+		{ "board", Profile::Board },
+	};
+
+	static const std::map<std::string, StreamMask> streams = {
+		{ "buttons", StreamButtons },
+		{ "accel", StreamMoteOrientation },
+		{ "chuck", StreamChuckOrientation },
+		{ "joy", StreamChuckJoystick },
+		{ "board", StreamBalanceBoard },
+		{ "ir", StreamIR },
+	};
+
+	if (auto it = presets.find(name); it != presets.end())
+		return it->second;
+
+	StreamMask mask = 0;
+	size_t begin = 0;
+	while (begin <= name.size()) {
+		size_t end = name.find('+', begin);
+		if (end == std::string::npos)
+			end = name.size();
+
+		auto it = streams.find(name.substr(begin, end - begin));
+		if (it == streams.end())
+			return std::nullopt;
+
+		mask |= it->second;
+		begin = end + 1;
+	}
+
+	return mask;
+}
+
+/*static*/ uint64_t Manager::timestampMicros()
+{
+	using namespace std::chrono;
+	return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void Manager::sendCommand(const Command& command)
+{
+	std::lock_guard<std::mutex> lock(mCommandMutex);
+	mCommands.push_back(command);
+}
+
+int Manager::claimId()
+{
+	std::lock_guard<std::mutex> lock(mIdMutex);
+
+	for (int id = 1; id <= DeviceRegistry::MaxId; ++id) {
+		const uint32_t bit = uint32_t(1) << (id - 1);
+		if (!((mLocalIds | mClaimedIds) & bit)) {
+			mClaimedIds |= bit;
+			return id;
+		}
+	}
+	return 0;
+}
+
 void Manager::init()
 {
-	mEvents.resize(mMaxQueueSize);
-	mLocalEventsCopy.resize(mMaxQueueSize);
+	mEvents.reserve(mMaxQueueSize);
+	mLocalEventsCopy.reserve(mMaxQueueSize);
 
 	if (!mWorkerThread) {
+		mHistory.configure(mHistoryConfig);
+		mRawHistory.configure(mRawHistoryConfig);
+		mHistoryStreams = ((mHistoryConfig.enabled ? mHistoryConfig.streams : 0) | (mRawHistoryConfig.enabled ? mRawHistoryConfig.streams : 0))
+			& HistoryRecordableStreams;
+
 		mWorker = std::make_unique<Worker>(*this);
+		{
+			std::lock_guard<std::mutex> lock(mIdMutex);
+			mWorker->load_registry();
+		}
 		mWorkerThread = std::thread(&Worker::run, mWorker.get());
 	}
 }
 
 void Manager::update()
 {
-    if (!mCallback)
-        return;
+	if (mWorker)
+		mWorker->save_registry();
 
-	mEventMutex.lock();
-	mLocalEventsCopy.swap(mEvents);
-	mEventMutex.unlock();
+	if (mSubscriptions.empty())
+		return;
 
-	for (EventFrame & frame : mLocalEventsCopy) {
-		for (size_t i = 0; i < MAX_WIIMOTES; ++i) {
-			if (frame[i].has_value()) {
-				mCallback(frame[i].value());
+	WIIMO_TRACE_ZONE("Manager::update");
+
+	{
+		WIIMO_TRACE_ZONE("take frames");
+		std::lock_guard<std::mutex> lock(mEventMutex);
+		mLocalEventsCopy.swap(mEvents);
+		mDrainStats.framesOverflowed = mOverflowedFrames;
+	}
+
+	// Poll-to-dispatch delay, smoothed; the worker adds it to the prediction horizon.
+	if (!mLocalEventsCopy.empty()) {
+		uint64_t latency = timestampMicros() - mLocalEventsCopy.front().timestamp;
+		mDrainStats.dispatchLatencyMicros = (mDrainStats.dispatchLatencyMicros * 7 + latency) / 8;
+		mDispatchLatencyMicros.store(mDrainStats.dispatchLatencyMicros, std::memory_order_relaxed);
+	}
+
+	mDrainStats.lastBacklog = mLocalEventsCopy.size();
+	mDrainStats.maxBacklog = std::max(mDrainStats.maxBacklog, mLocalEventsCopy.size());
+	mDrainStats.framesQueued += mLocalEventsCopy.size();
+
+	if (mDrainMode == DrainCoalesce && mLocalEventsCopy.size() > 1) {
+		EventFrame & merged = mCoalescedFrame;
+		merged.sequence = mLocalEventsCopy.back().sequence;
+		merged.timestamp = mLocalEventsCopy.back().timestamp;
+		merged.alignmentErrorMicros = mLocalEventsCopy.back().alignmentErrorMicros;
+		for (auto & c : merged.controllers)
+			c.reset();
+
+		for (EventFrame & frame : mLocalEventsCopy) {
+			for (size_t i = 0; i < MAX_WIIMOTES; ++i) {
+				if (!frame.controllers[i].has_value())
+					continue;
+
+				if (merged.controllers[i].has_value())
+					mergeEvents(*merged.controllers[i], *frame.controllers[i]);
+				else
+					merged.controllers[i] = std::move(frame.controllers[i]);
 			}
 		}
+
+		mDrainStats.framesMerged += mLocalEventsCopy.size() - 1;
+		dispatch(merged);
+	}
+	else {
+		for (EventFrame & frame : mLocalEventsCopy) {
+			dispatch(frame);
+		}
 	}
 
 	mLocalEventsCopy.clear();
 }
 
+void Manager::dispatch(const EventFrame& frame)
+{
+	WIIMO_TRACE_ZONE("dispatch");
+	mDrainStats.framesDelivered++;
+
+	StreamMask frameStreams = 0;
+	for (const auto & c : frame.controllers) {
+		if (c.has_value())
+			frameStreams |= c->streams();
+	}
+
+	for (const Subscription & sub : mSubscriptions) {
+		if (sub.frameCallback && (sub.streams & frameStreams))
+			sub.frameCallback(frame);
+	}
+
+	for (size_t i = 0; i < MAX_WIIMOTES; ++i) {
+		if (!frame.controllers[i].has_value())
+			continue;
+
+		const ControllerEvents & events = frame.controllers[i].value();
+		const StreamMask streams = events.streams();
+
+		for (const Subscription & sub : mSubscriptions) {
+			if (sub.callback && (sub.id == 0 || sub.id == events.id) && (sub.streams & streams))
+				sub.callback(events);
+		}
+	}
+}
+
+SubscriptionId Manager::subscribe(int id, StreamMask streams, std::function<void(const ControllerEvents&)> callback)
+{
+	if (id < 0 || id > MaxSubscriptionId) {
+		ofLogError() << "Cannot subscribe to controller id " << id << " (0 to " << MaxSubscriptionId << ").";
+		return 0;
+	}
+
+	Subscription sub;
+	sub.handle = mNextSubscription++;
+	sub.id = id;
+	sub.streams = streams;
+	sub.callback = std::move(callback);
+	mSubscriptions.push_back(std::move(sub));
+
+	publishSubscriptions();
+	return mSubscriptions.back().handle;
+}
+
+SubscriptionId Manager::subscribeFrames(StreamMask streams, std::function<void(const EventFrame&)> callback)
+{
+	Subscription sub;
+	sub.handle = mNextSubscription++;
+	sub.streams = streams;
+	sub.frameCallback = std::move(callback);
+
+	// Frame subscribers see every controller; they come first, as onEventFrame used to.
+	auto pos = std::find_if(mSubscriptions.begin(), mSubscriptions.end(), [](const Subscription & s) { return !s.frameCallback; });
+	SubscriptionId handle = sub.handle;
+	mSubscriptions.insert(pos, std::move(sub));
+
+	publishSubscriptions();
+	return handle;
+}
+
+void Manager::setSubscriptionStreams(SubscriptionId handle, StreamMask streams)
+{
+	for (Subscription & sub : mSubscriptions) {
+		if (sub.handle == handle)
+			sub.streams = streams;
+	}
+
+	publishSubscriptions();
+}
+
+void Manager::unsubscribe(SubscriptionId handle)
+{
+	mSubscriptions.erase(std::remove_if(mSubscriptions.begin(), mSubscriptions.end(),
+		[handle](const Subscription & sub) { return sub.handle == handle; }), mSubscriptions.end());
+
+	publishSubscriptions();
+}
+
+StreamMask Manager::subscribedStreams(int id) const
+{
+	StreamMask mask = mSubscribedStreams[0].load(std::memory_order_relaxed) | mHistoryStreams;
+	if (id > 0 && id <= MaxSubscriptionId)
+		mask |= mSubscribedStreams[id].load(std::memory_order_relaxed);
+	return mask;
+}
+
+void Manager::publishSubscriptions()
+{
+	std::array<StreamMask, MaxSubscriptionId + 1> masks = {};
+	for (const Subscription & sub : mSubscriptions)
+		masks[sub.id] |= sub.streams;
+
+	for (size_t i = 0; i < masks.size(); ++i)
+		mSubscribedStreams[i].store(masks[i], std::memory_order_relaxed);
+}
+
+/*static*/ void Manager::mergeEvents(ControllerEvents& into, const ControllerEvents& from)
+{
+	// Keep the full transition history before the per-button array is overwritten.
+	if (into.buttonEvents.empty()) {
+		into.forEachButtonTransition([&](MoteButton b, Transition t) {
+			into.buttonEvents.push_back({ b, t });
+		});
+	}
+	from.forEachButtonTransition([&](MoteButton b, Transition t) {
+		into.buttonEvents.push_back({ b, t });
+		into.moteButtonTransitions[b] = t;
+	});
+
+	if (from.moteOrientation)
+		into.moteOrientation = from.moteOrientation;
+	if (from.chuckOrientation)
+		into.chuckOrientation = from.chuckOrientation;
+	if (from.chuckJoystick)
+		into.chuckJoystick = from.chuckJoystick;
+	if (from.balanceBoard)
+		into.balanceBoard = from.balanceBoard;
+	if (from.predictedMoteOrientation)
+		into.predictedMoteOrientation = from.predictedMoteOrientation;
+	if (from.predictedChuckOrientation)
+		into.predictedChuckOrientation = from.predictedChuckOrientation;
+	if (from.predictedChuckJoystick)
+		into.predictedChuckJoystick = from.predictedChuckJoystick;
+
+	into.mergedFrames += from.mergedFrames;
+}
+
 } // namespace Wiimote
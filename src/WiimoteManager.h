@@ -5,9 +5,19 @@
 #include <memory>
 #include <thread>
 #include <deque>
+#include <vector>
 #include <atomic>
 #include <optional>
 #include <functional>
+#include <string>
+#include <cstdint>
+
+#include "Alignment.h"
+#include "History.h"
+#include "Polling.h"
+#include "Prediction.h"
+#include "Smoothing.h"
+#include "ThreadConfig.h"
 
 #define MAX_WIIMOTES 4
 
@@ -31,6 +41,12 @@ struct Joystick
     float y = 0.0;
 };
 
+// A joystick at x/y (-1..1), with angle and magnitude as wiiuse's
+// calc_joystick_state() derives them: degrees clockwise from up in
+// [0, 360), and the unclamped distance from the center. For stages that
+// compute x/y themselves, so their output keeps the device's convention.
+Joystick joystickFromXY(float x, float y);
+
 struct BalanceBoard
 {
 	float x = 0.0;
@@ -78,6 +94,42 @@ enum Transition
     TransitionReleased,
 };
 
+// Data streams a controller can produce; a StreamMask selects a subset of them.
+enum Stream : uint32_t
+{
+	StreamButtons          = 1 << 0,
+	StreamMoteOrientation  = 1 << 1,
+	StreamChuckOrientation = 1 << 2,
+	StreamChuckJoystick    = 1 << 3,
+	StreamBalanceBoard     = 1 << 4,
+	StreamIR               = 1 << 5,
+
+	StreamChuck            = StreamChuckOrientation | StreamChuckJoystick,
+	StreamAll              = 0xFFFFFFFF,
+};
+
+using StreamMask = uint32_t;
+
+/**
+ *	Report profiles: the streams a controller is expected to deliver. The
+ *	worker configures each device with the smallest report mode covering
+ *	its profile (accelerometer/IR on or off) and skips everything else.
+ */
+namespace Profile
+{
+	constexpr StreamMask Full         = StreamButtons | StreamMoteOrientation | StreamChuck | StreamBalanceBoard;
+	constexpr StreamMask Buttons      = StreamButtons;
+	constexpr StreamMask ButtonsAccel = StreamButtons | StreamMoteOrientation;
+	constexpr StreamMask Nunchuk      = StreamButtons | StreamChuck;
+	constexpr StreamMask Board        = StreamBalanceBoard;
+}
+
+struct ButtonEvent
+{
+	MoteButton button = MoteButtonBegin;
+	Transition transition = TransitionNone;
+};
+
 struct ControllerEvents
 {
     int id = 0;
@@ -86,9 +138,138 @@ struct ControllerEvents
     std::optional<Orientation> chuckOrientation;
 	std::optional<Joystick> chuckJoystick;
 
-    std::array<Transition, static_cast<size_t>(MoteButton::MoteButtonEnd)> moteButtonTransitions;
+    std::array<Transition, static_cast<size_t>(MoteButton::MoteButtonEnd)> moteButtonTransitions = {};
 
     std::optional<BalanceBoard> balanceBoard;
+
+	// Values extrapolated by the prediction stage (see PredictionConfig),
+	// set next to the raw values they were predicted from.
+	std::optional<Orientation> predictedMoteOrientation;
+	std::optional<Orientation> predictedChuckOrientation;
+	std::optional<Joystick> predictedChuckJoystick;
+
+	// Number of polled events merged into this one (see DrainCoalesce).
+	int mergedFrames = 1;
+
+	// When events were merged: every button transition, in order. A button can
+	// appear several times (e.g. pressed and released), which the per-button
+	// moteButtonTransitions cannot express.
+	std::vector<ButtonEvent> buttonEvents;
+
+	// Streams carried by these events (StreamButtons if any button changed).
+	StreamMask streams() const
+	{
+		StreamMask mask = 0;
+		if (moteOrientation) mask |= StreamMoteOrientation;
+		if (chuckOrientation) mask |= StreamChuckOrientation;
+		if (chuckJoystick) mask |= StreamChuckJoystick;
+		if (balanceBoard) mask |= StreamBalanceBoard;
+		if (!buttonEvents.empty())
+			mask |= StreamButtons;
+		for (Transition t : moteButtonTransitions) {
+			if (t != TransitionNone)
+				mask |= StreamButtons;
+		}
+		return mask;
+	}
+
+	// Visits all button transitions in order, whether or not events were merged.
+	template <typename F>
+	void forEachButtonTransition(F&& f) const
+	{
+		if (!buttonEvents.empty()) {
+			for (const ButtonEvent& e : buttonEvents)
+				f(e.button, e.transition);
+			return;
+		}
+
+		for (int b = MoteButtonBegin; b < MoteButtonEnd; ++b) {
+			if (moteButtonTransitions[b] != TransitionNone)
+				f(MoteButton(b), moteButtonTransitions[b]);
+		}
+	}
+};
+
+// All controller events collected by one poll of the worker.
+struct EventFrame
+{
+	uint32_t sequence = 0;  // Incremented for every frame the worker queues; frames merged by DrainCoalesce leave gaps.
+	uint64_t timestamp = 0; // Manager::timestampMicros() when the frame was polled, or its clock tick if aligned.
+
+	// Aligned frames: largest distance between the tick and a report the values were built from.
+	uint32_t alignmentErrorMicros = 0;
+
+	std::array<std::optional<ControllerEvents>, MAX_WIIMOTES> controllers;
+};
+
+using SubscriptionId = int;
+
+/**
+ *	A consumer of controller events, registered with Manager::subscribe().
+ *	The worker only extracts the union of all subscribed streams (within
+ *	each controller's profile), so unsubscribed data costs nothing.
+ */
+struct Subscription
+{
+	SubscriptionId handle = 0;
+	int id = 0;             // Controller id; 0 subscribes to all controllers.
+	StreamMask streams = 0;
+
+	// Exactly one of them is set.
+	std::function<void(const ControllerEvents&)> callback;
+	std::function<void(const EventFrame&)> frameCallback;
+};
+
+enum DrainMode
+{
+	DrainAll,      // Deliver every queued frame.
+	DrainCoalesce, // Merge all queued frames into one per update.
+};
+
+struct DrainStats
+{
+	uint64_t framesQueued = 0;    // Frames taken from the worker queue.
+	uint64_t framesDelivered = 0; // Frames passed to the callbacks.
+	uint64_t framesMerged = 0;    // Frames folded into another one by DrainCoalesce.
+	size_t lastBacklog = 0;       // Queue length at the last update().
+	size_t maxBacklog = 0;        // Longest queue seen by update().
+	uint64_t framesOverflowed = 0; // Frames the worker folded into the newest queued one because the queue was full.
+	uint64_t dispatchLatencyMicros = 0; // Smoothed delay from poll to dispatch.
+};
+
+enum CommandType
+{
+	CommandMotion,      // Accelerometer/orientation reporting on/off.
+	CommandIR,          // IR camera on/off.
+	CommandMotionPlus,  // Motion+ on (nunchuk pass-through if attached)/off.
+	CommandRumble,      // Rumble on/off.
+	CommandLeds,        // LED bitmask, bit 0 = LED 1.
+	CommandProfile,     // Report profile (StreamMask).
+};
+
+struct Command
+{
+	int id = 0;         // Controller id; 0 addresses all controllers.
+	CommandType type = CommandMotion;
+	int value = 0;
+};
+
+/**
+ *	A scripted device in place of wiiuse, for load tests without hardware
+ *	(see runSoak()). The worker produces a frame for all controllers at
+ *	rateHz and runs it through the normal stages. Mote orientation follows a
+ *	slow sine so smoothing and prediction see realistic input. The balance
+ *	board corner weights, which those stages leave alone, carry the frame
+ *	number (tr, modulo 2^24), the timestamp (tl, microseconds modulo 2^24)
+ *	and the controller slot (br), so a receiver can measure loss and latency;
+ *	button A toggles every 50 frames. Alignment resamples the corner weights
+ *	too, so leave it off when measuring.
+ */
+struct SimulationConfig
+{
+	bool enabled = false;
+	int controllers = 1;
+	double rateHz = 100.0;
 };
 
 class Manager {
@@ -98,25 +279,159 @@ public:
 
 	static std::optional<int> buttonToWiimoteCode(MoteButton button);
 
+	// Monotonic clock used for frame timestamps, in microseconds.
+	static uint64_t timestampMicros();
+
+	// Accepts "full", "buttons", "buttons+accel", "nunchuk", "board", or a
+	// '+'-separated list of "buttons", "accel", "chuck", "joy", "board", "ir".
+	static std::optional<StreamMask> profileFromName(const std::string& name);
+
     void init();
     void update();
 
-    void onControllerEvents(std::function<void(const ControllerEvents&)> callback) {
-        mCallback = callback;
-    }
+	/**
+	 *	With DrainCoalesce, when update() finds several frames queued (the
+	 *	caller fell behind), they are merged into one frame: latest values
+	 *	for continuous streams, and the ordered list of all button
+	 *	transitions in ControllerEvents::buttonEvents. Catch-up then costs
+	 *	one callback per controller instead of one per queued frame.
+	 */
+	void setDrainMode(DrainMode mode) { mDrainMode = mode; }
+	const DrainStats& drainStats() const { return mDrainStats; }
+
+	// Must be called before init() to take effect.
+	void setPollConfig(const PollConfig& config) { mPollConfig = config; }
+	const PollConfig& pollConfig() const { return mPollConfig; }
+	PollStats pollStats() const;
+
+	// Must be called before init() to take effect.
+	void setSmoothingConfig(const SmoothingConfig& config) { mSmoothingConfig = config; }
+
+	// Must be called before init() to take effect.
+	void setPredictionConfig(const PredictionConfig& config) { mPredictionConfig = config; }
+
+	/**
+	 *	With alignment enabled, the worker resamples all controllers onto a
+	 *	fixed-rate clock (see Aligner) and queues aligned frames instead of
+	 *	the polled ones. Must be called before init() to take effect.
+	 */
+	void setAlignmentConfig(const AlignmentConfig& config) { mAlignmentConfig = config; }
+	AlignmentStats alignmentStats() const;
+
+	// Per-controller history rings (see HistoryRing). Must be called before init() to take effect.
+	void setHistoryConfig(const HistoryConfig& config) { mHistoryConfig = config; }
+	const HistoryConfig& historyConfig() const { return mHistoryConfig; }
+
+	// Recent samples of a stream of controller id, for lock-free windowed
+	// queries from any thread; nullptr without history or before the
+	// controller first reported the stream.
+	const HistoryRing* history(int id, HistoryStream stream) const { return mHistory.ring(id, stream); }
+
+	// The same for the raw values: recorded before smoothing and prediction,
+	// one sample per report. Must be called before init() to take effect.
+	void setRawHistoryConfig(const HistoryConfig& config) { mRawHistoryConfig = config; }
+	const HistoryRing* rawHistory(int id, HistoryStream stream) const { return mRawHistory.ring(id, stream); }
+
+	// Replaces the devices with a scripted one. Must be called before init() to take effect.
+	void setSimulationConfig(const SimulationConfig& config) { mSimulationConfig = config; }
+
+	// File remembering known controllers (address, id, profile), for direct
+	// reconnection and stable ids across restarts. Empty disables it.
+	// Must be called before init() to take effect.
+	void setRegistryPath(const std::string& path) { mRegistryPath = path; }
+
+	/**
+	 *	Claims a controller id for a controller that is not connected
+	 *	locally, e.g. one relayed by WiimoAggregator: the lowest id that
+	 *	neither the registry nor an earlier claim uses. Controllers that
+	 *	are registered later skip claimed ids. Returns 0 if all are taken.
+	 */
+	int claimId();
+
+	// Must be called before init() to take effect.
+	void setWorkerThreadConfig(const ThreadConfig& config) { mWorkerThreadConfig = config; }
+
+	// Queues a command; the worker applies it between two polls.
+	void sendCommand(const Command& command);
+
+	// Sets the report profile of a controller (0 = all); see Profile.
+	void setProfile(int id, StreamMask profile) { sendCommand({ id, CommandProfile, static_cast<int>(profile) }); }
+
+	// Highest controller id a subscription can name (see DeviceRegistry::MaxId).
+	static constexpr int MaxSubscriptionId = 32;
+
+	/**
+	 *	Calls back, from update(), with the events of controller id (0 = all)
+	 *	that carry at least one of the given streams. The events can also
+	 *	carry streams other subscribers asked for.
+	 *
+	 *	Subscriptions are managed from the thread calling update(), but not
+	 *	from within a callback. Returns 0 (no subscription) for an id out
+	 *	of range.
+	 */
+	SubscriptionId subscribe(int id, StreamMask streams, std::function<void(const ControllerEvents&)> callback);
+
+	// Calls back once per frame holding any of the given streams, before the per-controller callbacks.
+	SubscriptionId subscribeFrames(StreamMask streams, std::function<void(const EventFrame&)> callback);
+
+	// Changes the streams of a subscription; 0 pauses it.
+	void setSubscriptionStreams(SubscriptionId handle, StreamMask streams);
+	void unsubscribe(SubscriptionId handle);
+
+	// Union of the streams subscribed for controller id; read by the worker.
+	StreamMask subscribedStreams(int id) const;
 
 private:
     std::unique_ptr<Worker> mWorker;
     std::optional<std::thread> mWorkerThread;
 
-	const size_t mMaxQueueSize = 16;
-	using EventFrame = std::array<std::optional<ControllerEvents>, MAX_WIIMOTES>;
+	// Frames the worker queues between two update() calls; beyond that it
+	// merges new frames into the newest queued one (see DrainStats).
+	const size_t mMaxQueueSize = 256;
 
     std::mutex mEventMutex;
     std::vector<EventFrame> mEvents;
+	uint64_t mOverflowedFrames = 0; // Guarded by mEventMutex.
 	std::vector<EventFrame> mLocalEventsCopy;
 
-    std::function<void(const ControllerEvents&)> mCallback = {};
+	DrainMode mDrainMode = DrainAll;
+	DrainStats mDrainStats;
+	EventFrame mCoalescedFrame;
+
+	void dispatch(const EventFrame& frame);
+	static void mergeEvents(ControllerEvents& into, const ControllerEvents& from);
+
+	std::vector<Subscription> mSubscriptions;
+	SubscriptionId mNextSubscription = 1;
+
+	// Index 0 holds the streams subscribed for all controllers.
+	std::array<std::atomic<StreamMask>, MaxSubscriptionId + 1> mSubscribedStreams = {};
+
+	void publishSubscriptions();
+
+	std::mutex mCommandMutex;
+	std::vector<Command> mCommands;
+
+	PollConfig mPollConfig;
+	SmoothingConfig mSmoothingConfig;
+	PredictionConfig mPredictionConfig;
+	AlignmentConfig mAlignmentConfig;
+	SimulationConfig mSimulationConfig;
+	HistoryConfig mHistoryConfig;
+	History mHistory;
+	HistoryConfig mRawHistoryConfig;
+	History mRawHistory;
+	StreamMask mHistoryStreams = 0; // Extracted for the history whether subscribed or not.
+	std::atomic<uint64_t> mDispatchLatencyMicros{ 0 };
+	ThreadConfig mWorkerThreadConfig;
+	std::string mRegistryPath;
+
+	// Controller ids in use, bit id - 1: by local controllers (the registry,
+	// or the slots without one) and by claimId(). The mutex also guards
+	// changes to the worker's registry.
+	std::mutex mIdMutex;
+	uint32_t mLocalIds = (uint32_t(1) << MAX_WIIMOTES) - 1;
+	uint32_t mClaimedIds = 0;
 
     friend class Worker;
 };
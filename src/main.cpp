@@ -1,8 +1,138 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "Soak.h"
+
+#include <cstdlib>
+#include <cstring>
 
 //========================================================================
-int main( ){
+int main(int argc, char ** argv){
+	// Compare the binary wire format against OSC.
+	if (argc > 1 && std::strcmp(argv[1], "--wire-bench") == 0) {
+		runWireBenchmark();
+		return 0;
+	}
+
+	// Loopback aggregation: "--aggregate [port] [seconds]" in one process,
+	// "--fake-node <node> [port] [controllers]" in others.
+	if (argc > 1 && std::strcmp(argv[1], "--aggregate") == 0) {
+		runAggregator(argc > 2 ? std::atoi(argv[2]) : 12024, argc > 3 ? std::atoi(argv[3]) : 10);
+		return 0;
+	}
+
+	// Sequence handling of the aggregator: late frames, restarts, wrap-around.
+	if (argc > 1 && std::strcmp(argv[1], "--aggregate-test") == 0) {
+		return runAggregatorTest() ? 0 : 1;
+	}
+
+	if (argc > 2 && std::strcmp(argv[1], "--fake-node") == 0) {
+		runFakeNode(static_cast<uint16_t>(std::atoi(argv[2])), "127.0.0.1", argc > 3 ? std::atoi(argv[3]) : 12024,
+			argc > 4 ? std::atoi(argv[4]) : 4, 100.0, 10);
+		return 0;
+	}
+
+	// Cost of evaluating thousands of compiled OSC mappings per frame.
+	if (argc > 1 && std::strcmp(argv[1], "--mapping-bench") == 0) {
+		runMappingBenchmark();
+		return 0;
+	}
+
+	// End-to-end load test with a simulated device; fails (exit code 1) when a budget is exceeded.
+	if (argc > 1 && std::strcmp(argv[1], "--soak") == 0) {
+		SoakConfig config;
+		if (argc > 2)
+			config.duration = std::chrono::seconds(std::max(1, std::atoi(argv[2])));
+		if (argc > 3)
+			config.fps = std::atof(argv[3]);
+		config.appStages = &ofApp::configureStages;
+		return runSoak(config) ? 0 : 1;
+	}
+
+	// OSC/TCP delivery and drop accounting against a loopback listener.
+	if (argc > 1 && std::strcmp(argv[1], "--tcp-test") == 0) {
+		return runOscTcpTest(argc > 2 ? std::atoi(argv[2]) : 12032) ? 0 : 1;
+	}
+
+	// Cost of history writes and windowed queries, with a concurrent reader.
+	if (argc > 1 && std::strcmp(argv[1], "--history-bench") == 0) {
+		Wiimote::runHistoryBenchmark();
+		return 0;
+	}
+
+	// Cost and effect of the One Euro filter bank.
+	if (argc > 1 && std::strcmp(argv[1], "--smooth-bench") == 0) {
+		Wiimote::runSmoothingBenchmark(std::chrono::seconds(2));
+		return 0;
+	}
+
+	// Smoothed values keep the device's conventions.
+	if (argc > 1 && std::strcmp(argv[1], "--smooth-test") == 0) {
+		return Wiimote::runSmoothingTest() ? 0 : 1;
+	}
+
+	// Prediction error against horizon on a motion recording (or synthetic motion without one).
+	if (argc > 1 && std::strcmp(argv[1], "--predict-eval") == 0) {
+		Wiimote::runPredictionEvaluation(argc > 2 ? argv[2] : "", Wiimote::PredictionConfig());
+		return 0;
+	}
+
+	// Error and added latency of resampling irregular reports onto a common clock.
+	if (argc > 1 && std::strcmp(argv[1], "--align-eval") == 0) {
+		Wiimote::AlignmentConfig config;
+		config.enabled = true;
+		if (argc > 2)
+			config.rateHz = std::atof(argv[2]);
+		Wiimote::runAlignmentEvaluation(config);
+		return 0;
+	}
+
+#ifndef _WIN32
+	// Compare the worker's poll modes against a fake device, then exit.
+	if (argc > 1 && std::strcmp(argv[1], "--poll-bench") == 0) {
+		Wiimote::runPollBenchmark(100.0, std::chrono::seconds(5));
+		return 0;
+	}
+
+	// Compare poll-thread jitter under full CPU load with and without
+	// real-time settings, e.g. "--jitter-bench 2,3 fifo".
+	if (argc > 1 && std::strcmp(argv[1], "--jitter-bench") == 0) {
+		Wiimote::ThreadConfig config;
+		config.scheduling = Wiimote::ThreadSchedulingFifo;
+		if (argc > 2)
+			config.cpus = Wiimote::parseCpuList(argv[2]);
+		if (argc > 3 && std::strcmp(argv[3], "rr") == 0)
+			config.scheduling = Wiimote::ThreadSchedulingRoundRobin;
+
+		Wiimote::runJitterBenchmark(config, std::chrono::seconds(5));
+		return 0;
+	}
+#endif
+
+	// Poll settings for the app: "--poll-mode spin|block|hybrid", and the poll
+	// thread placement, e.g. "--poll-cpus 2,3 --poll-priority 80" (real-time
+	// priority with SCHED_FIFO, or round-robin with "--poll-rr").
+	Wiimote::PollConfig poll;
+	Wiimote::ThreadConfig pollThread;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--poll-mode") == 0 && i + 1 < argc) {
+			if (!Wiimote::parsePollMode(argv[++i], poll.mode)) {
+				ofLogError() << "Unknown poll mode '" << argv[i] << "' (spin, block or hybrid).";
+				return 1;
+			}
+		}
+		else if (std::strcmp(argv[i], "--poll-cpus") == 0 && i + 1 < argc) {
+			pollThread.cpus = Wiimote::parseCpuList(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--poll-priority") == 0 && i + 1 < argc) {
+			pollThread.priority = std::atoi(argv[++i]);
+			if (pollThread.scheduling == Wiimote::ThreadSchedulingDefault)
+				pollThread.scheduling = Wiimote::ThreadSchedulingFifo;
+		}
+		else if (std::strcmp(argv[i], "--poll-rr") == 0) {
+			pollThread.scheduling = Wiimote::ThreadSchedulingRoundRobin;
+		}
+	}
+
 	//Use ofGLFWWindowSettings for more options like multi-monitor fullscreen
 	ofGLWindowSettings settings;
 	settings.setSize(800, 600);
@@ -10,6 +140,10 @@ int main( ){
 
 	auto window = ofCreateWindow(settings);
 
-	ofRunApp(window, make_shared<ofApp>());
+	auto app = make_shared<ofApp>();
+	app->setPollConfig(poll);
+	app->setWorkerThreadConfig(pollThread);
+
+	ofRunApp(window, app);
 	ofRunMainLoop();
 }
@@ -1,9 +1,35 @@
 #include "ofApp.h"
 
+//--------------------------------------------------------------
+/*static*/ void ofApp::configureStages(Wiimote::Manager & manager)
+{
+	manager.setDrainMode(Wiimote::DrainCoalesce);
+
+	Wiimote::SmoothingConfig smoothing;
+	smoothing.enabled = true;
+	manager.setSmoothingConfig(smoothing);
+
+	Wiimote::PredictionConfig prediction;
+	prediction.enabled = true;
+	manager.setPredictionConfig(prediction);
+
+	Wiimote::HistoryConfig history;
+	history.enabled = true;
+	history.streams = Wiimote::StreamMoteOrientation;
+	manager.setHistoryConfig(history);
+
+	// Unfiltered mote orientation at the report rate, for the motion recorder ('r').
+	Wiimote::HistoryConfig raw;
+	raw.enabled = true;
+	raw.streams = Wiimote::StreamMoteOrientation;
+	manager.setRawHistoryConfig(raw);
+}
+
 //--------------------------------------------------------------
 void ofApp::setup()
 { 
     ofSetLogLevel(OF_LOG_VERBOSE);
+	Trace::setThreadName("main");
 
     mGui.setup();
 
@@ -12,40 +38,148 @@ void ofApp::setup()
     //gui.add(&button);
 	mGui.add(mGuiOscHost.setup("Host", "127.0.0.1"));
 	mGui.add(mGuiOscPort.setup("Port", 12021, 1, 99999));
+	mGui.add(mGuiOscTcp.setup("OSC over TCP", false));
 	mGui.add(mGuiOscState.setup("OSC", "disconnected"));
+	mGui.add(mGuiControlPort.setup("Control port", 12022, 1, 99999));
+	mGui.add(mGuiBinaryEnabled.setup("Binary output", false));
+	mGui.add(mGuiBinaryPort.setup("Binary port", 12023, 1, 99999));
+	mGui.add(mGuiShmEnabled.setup("Shared memory", false));
+	mGui.add(mGuiNodeId.setup("Node id", 0, 0, 65535));
+	mGui.add(mGuiAggregate.setup("Aggregate nodes", false));
+	mGui.add(mGuiAggregatePort.setup("Aggregator port", 12024, 1, 99999));
+	mGui.add(mGuiPollState.setup("Poll", "-"));
+	mGui.add(mGuiOutputRate.setup("Out", "-"));
 
 	mGuiOscHost.addListener(this, &ofApp::guiOscHostChanged);
 	mGuiOscPort.addListener(this, &ofApp::guiOscPortChanged);
+	mGuiOscTcp.addListener(this, &ofApp::guiOscTcpChanged);
+	mGuiControlPort.addListener(this, &ofApp::guiControlPortChanged);
+	mGuiBinaryEnabled.addListener(this, &ofApp::guiBinaryChanged);
+	mGuiBinaryPort.addListener(this, &ofApp::guiBinaryPortChanged);
+	mGuiShmEnabled.addListener(this, &ofApp::guiShmChanged);
+	mGuiNodeId.addListener(this, &ofApp::guiNodeIdChanged);
+	mGuiAggregate.addListener(this, &ofApp::guiAggregateChanged);
+	mGuiAggregatePort.addListener(this, &ofApp::guiAggregatePortChanged);
 	
+	mWiimoteManager.setRegistryPath(ofToDataPath("wiimotes.txt", true));
+	configureStages(mWiimoteManager);
+	mHistoryWindow.resize(mWiimoteManager.historyConfig().capacity);
     mWiimoteManager.init();
-    mWiimoteManager.onControllerEvents([this](const Wiimote::ControllerEvents& events) {
+    mWiimoteManager.subscribe(0, Wiimote::StreamButtons, [this](const Wiimote::ControllerEvents& events) {
         this->onControllerEvents(events);
-
-		mOscOut.processControllerEvents(events);
     });
+	mOscSubscription = mWiimoteManager.subscribe(0, WiimoOscOutput::Streams, [this](const Wiimote::ControllerEvents& events) {
+		mOscOut.processControllerEvents(events);
+	});
+	loadMapping();
+
+	// Binary and shared-memory outputs carry everything, but only while one of them is enabled.
+	mFrameSubscription = mWiimoteManager.subscribeFrames(0, [this](const Wiimote::EventFrame& frame) {
+		if (mBinaryOut.isReady())
+			mBinaryOut.processEventFrame(frame);
+		if (mShmOut.isReady())
+			mShmOut.processEventFrame(frame);
+	});
+
+	// Controllers of other nodes go out through the same outputs, with ids no local controller uses.
+	mAggregator.setIdAllocator([this] { return mWiimoteManager.claimId(); });
+	mAggregator.onControllerEvents([this](const Wiimote::ControllerEvents& events) {
+		mOscOut.processControllerEvents(events);
+	});
+	mAggregator.onFrame([this](const WiimoWire::Frame& frame) {
+		if (mBinaryOut.isReady())
+			mBinaryOut.processWireFrame(frame);
+		if (mShmOut.isReady())
+			mShmOut.processWireFrame(frame);
+	});
 
 	handleOscSetup();
+	mOscControl.setup(mGuiControlPort);
 }
 
 //--------------------------------------------------------------
 void ofApp::update()
 {
+	WIIMO_TRACE_ZONE("ofApp::update");
+
+	mOscControl.update(mWiimoteManager);
     mWiimoteManager.update();
+	mAggregator.update();
+	mOscOut.flush();
+
+	if (mRecording.is_open())
+		recordMotion();
+
+	if (mGuiOscTcp) {
+		auto & tcp = mOscOut.tcp().stats();
+		mGuiOscState = std::string(mOscOut.tcp().isConnected() ? "tcp connected" : "tcp connecting")
+			+ ", dropped " + ofToString(tcp.droppedContinuous) + "/" + ofToString(tcp.droppedCritical);
+	}
+
+	auto poll = mWiimoteManager.pollStats();
+	mGuiPollState = std::string(Wiimote::pollModeName(mWiimoteManager.pollConfig().mode)) + ", "
+		+ ofToString(static_cast<int>(poll.cpuLoad() * 100.0)) + "% cpu, " + ofToString(poll.events) + " reports";
+
+	// Output bandwidth, refreshed once per second.
+	uint64_t now = ofGetElapsedTimeMicros();
+	if (now - mLastRateTime >= 1000000) {
+		double seconds = (now - mLastRateTime) * 1e-6;
+		double osc = (mOscOut.bytesSent() - mLastOscBytes) / seconds / 1000.0;
+		double bin = (mBinaryOut.bytesSent() - mLastBinaryBytes) / seconds / 1000.0;
+		mGuiOutputRate = "osc " + ofToString(osc, 1) + " kB/s, bin " + ofToString(bin, 1) + " kB/s";
+
+		mLastRateTime = now;
+		mLastOscBytes = mOscOut.bytesSent();
+		mLastBinaryBytes = mBinaryOut.bytesSent();
+	}
 }
 
 void ofApp::onControllerEvents(const Wiimote::ControllerEvents& events)
 {
-	for (int i = 0; i < Wiimote::MoteButtonEnd; ++i) {
-        if (auto t = events.moteButtonTransitions[i]; t != Wiimote::TransitionNone) {
-            ofLogNotice() << events.id << " BUTTON " << i << " :: " << (t == Wiimote::TransitionPressed ? "Pressed" : "Released");
-        }
-    }
+	events.forEachButtonTransition([&](Wiimote::MoteButton b, Wiimote::Transition t) {
+        ofLogNotice() << events.id << " BUTTON " << b << " :: " << (t == Wiimote::TransitionPressed ? "Pressed" : "Released");
+    });
 }
 
 //--------------------------------------------------------------
 void ofApp::draw()
 {
 	ofBackground(50, 50, 50);
+
+	// The last two seconds of mote roll of every controller, from the history rings.
+	const uint64_t span = 2000000;
+	const uint64_t now = Wiimote::Manager::timestampMicros();
+	const uint64_t from = now > span ? now - span : 0;
+	const float left = 240.0f, width = ofGetWidth() - left - 20.0f, height = 90.0f;
+
+	int row = 0;
+	for (int id = 1; id <= Wiimote::Manager::MaxSubscriptionId && row < MAX_WIIMOTES; ++id) {
+		const Wiimote::HistoryRing* ring = mWiimoteManager.history(id, Wiimote::HistoryMoteOrientation);
+		if (!ring)
+			continue;
+
+		const float top = 20.0f + row++ * (height + 20.0f);
+		const float middle = top + height / 2;
+
+		ofPolyline roll;
+		size_t n = ring->range(from, now + 1, mHistoryWindow.data(), mHistoryWindow.size());
+		for (size_t i = 0; i < n; ++i) {
+			const auto & sample = mHistoryWindow[i];
+			roll.addVertex(left + width * (sample.timestamp - from) / span, middle - sample.values[0] / 180.0f * height / 2);
+		}
+
+		ofSetColor(90);
+		ofDrawLine(left, middle, left + width, middle);
+		ofSetColor(255, 170, 60);
+		roll.draw();
+
+		const Wiimote::HistoryStats stats = ring->stats();
+		ofSetColor(200);
+		ofDrawBitmapString("#" + std::to_string(id) + " roll  mean " + ofToString(stats.mean[0], 1) + "  rms " + ofToString(stats.rms[0], 1)
+			+ "  min " + ofToString(stats.min[0], 1) + "  max " + ofToString(stats.max[0], 1), left, top + 12);
+	}
+
+	ofSetColor(255);
     mGui.draw();
 }
 
@@ -59,15 +193,141 @@ void ofApp::guiOscPortChanged(int & port)
 	handleOscSetup();
 }
 
+void ofApp::guiControlPortChanged(int & port)
+{
+	mOscControl.setup(port);
+}
+
+void ofApp::guiOscTcpChanged(bool & tcp)
+{
+	handleOscSetup();
+}
+
+void ofApp::guiBinaryChanged(bool & enabled)
+{
+	handleBinarySetup();
+}
+
+void ofApp::guiBinaryPortChanged(int & port)
+{
+	handleBinarySetup();
+}
+
+void ofApp::guiShmChanged(bool & enabled)
+{
+	if (enabled)
+		mShmOut.setup();
+	else
+		mShmOut.close();
+
+	updateFrameSubscription();
+}
+
+void ofApp::guiNodeIdChanged(int & node)
+{
+	mBinaryOut.setNode(static_cast<uint16_t>(node));
+}
+
+void ofApp::guiAggregateChanged(bool & enabled)
+{
+	handleAggregatorSetup();
+}
+
+void ofApp::guiAggregatePortChanged(int & port)
+{
+	handleAggregatorSetup();
+}
+
+void ofApp::handleAggregatorSetup()
+{
+	if (mGuiAggregate)
+		mAggregator.setup(mGuiAggregatePort);
+	else
+		mAggregator.close();
+}
+
 void ofApp::handleOscSetup()
 {
-	bool r  = mOscOut.setup(mGuiOscHost, mGuiOscPort);
+	bool r  = mOscOut.setup(mGuiOscHost, mGuiOscPort, mGuiOscTcp ? OscTransportTcp : OscTransportUdp);
 	mGuiOscState = r ? "connected" : "disconnected";
+
+	handleBinarySetup();
+}
+
+void ofApp::handleBinarySetup()
+{
+	if (mGuiBinaryEnabled)
+		mBinaryOut.setup(mGuiOscHost, mGuiBinaryPort);
+	else
+		mBinaryOut.close();
+
+	updateFrameSubscription();
+}
+
+void ofApp::updateFrameSubscription()
+{
+	if (mFrameSubscription)
+		mWiimoteManager.setSubscriptionStreams(mFrameSubscription, (mBinaryOut.isReady() || mShmOut.isReady()) ? Wiimote::StreamAll : 0);
 }
 
 //--------------------------------------------------------------
-void ofApp::keyPressed(int key){
+void ofApp::recordMotion()
+{
+	// Every report since the last call, from the raw history: coalesced frames
+	// would thin it out to the app's frame rate, and smoothed ones distort it.
+	for (int id = 1; id <= Wiimote::Manager::MaxSubscriptionId; ++id) {
+		const Wiimote::HistoryRing* ring = mWiimoteManager.rawHistory(id, Wiimote::HistoryMoteOrientation);
+		if (!ring)
+			continue;
+
+		size_t n;
+		do {
+			n = ring->range(mRecordedUntil[id], UINT64_MAX, mHistoryWindow.data(), mHistoryWindow.size());
+			for (size_t i = 0; i < n; ++i) {
+				const auto & sample = mHistoryWindow[i];
+				mRecording << id << ' ' << sample.timestamp << ' ' << sample.values[0] << ' ' << sample.values[1] << ' ' << sample.values[2] << '\n';
+				mRecordedUntil[id] = sample.timestamp + 1;
+			}
+		} while (n && n == mHistoryWindow.size());
+	}
+}
 
+//--------------------------------------------------------------
+void ofApp::loadMapping()
+{
+	std::string path = ofToDataPath("mapping.txt", true);
+	if (!mOscOut.loadMapping(path))
+		ofLogVerbose() << "No OSC mapping at " << path << ".";
+
+	mWiimoteManager.setSubscriptionStreams(mOscSubscription, mOscOut.streams());
+}
+
+//--------------------------------------------------------------
+void ofApp::keyPressed(int key){
+	if (key == 't') {
+		Trace::setEnabled(!Trace::isEnabled());
+	}
+	else if (key == 'd') {
+		Trace::dump(ofToDataPath("trace.json", true));
+	}
+	else if (key == 'm') {
+		loadMapping();
+	}
+
+	if (key == 'r') {
+		if (mRecording.is_open()) {
+			recordMotion();
+			mRecording.close();
+			ofLogNotice() << "Motion recording stopped.";
+		}
+		else {
+			std::string path = ofToDataPath("motion.txt", true);
+			mRecording.open(path);
+			mRecording << "# id timestamp_us roll pitch yaw\n";
+			mRecordedUntil.fill(Wiimote::Manager::timestampMicros());
+			ofLogNotice() << "Recording motion to " << path << " ('r' to stop).";
+		}
+	}
 }
 
 //--------------------------------------------------------------
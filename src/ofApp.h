@@ -3,10 +3,17 @@
 #include "ofMain.h"
 #include "ofxGui.h"
 
+#include <array>
+#include <fstream>
 #include <string>
+#include <vector>
 
 #include "WiimoteManager.h"
 #include "Output.h"
+#include "Control.h"
+#include "BinaryOutput.h"
+#include "SharedMemoryOutput.h"
+#include "Aggregator.h"
 
 class ofApp : public ofBaseApp
 {
@@ -17,19 +24,68 @@ class ofApp : public ofBaseApp
 
     ofxInputField<std::string> mGuiOscHost;
 	ofxInputField<int> mGuiOscPort;
+	ofxToggle mGuiOscTcp;
 	ofxLabel mGuiOscState;
+	ofxInputField<int> mGuiControlPort;
+	ofxToggle mGuiBinaryEnabled;
+	ofxInputField<int> mGuiBinaryPort;
+	ofxToggle mGuiShmEnabled;
+	ofxInputField<int> mGuiNodeId;
+	ofxToggle mGuiAggregate;
+	ofxInputField<int> mGuiAggregatePort;
+	ofxLabel mGuiOutputRate;
+	ofxLabel mGuiPollState;
 
 	WiimoOscOutput mOscOut;
+	WiimoOscControl mOscControl;
+	WiimoBinaryOutput mBinaryOut;
+	WiimoShmOutput mShmOut;
+	WiimoAggregator mAggregator;
+
+	Wiimote::SubscriptionId mOscSubscription = 0;
+	Wiimote::SubscriptionId mFrameSubscription = 0;
+
+	// Motion recorder ('r'), for the offline prediction evaluation: next
+	// timestamp to write, per controller id.
+	std::ofstream mRecording;
+	std::array<uint64_t, Wiimote::Manager::MaxSubscriptionId + 1> mRecordedUntil = {};
+
+	// Query buffer for the motion plot in draw() and the recorder.
+	std::vector<Wiimote::HistorySample> mHistoryWindow;
+
+	uint64_t mLastRateTime = 0;
+	uint64_t mLastOscBytes = 0;
+	uint64_t mLastBinaryBytes = 0;
 
 public:
+	// Set from the command line before setup(), which starts the worker.
+	void setPollConfig(const Wiimote::PollConfig & config) { mWiimoteManager.setPollConfig(config); }
+	void setWorkerThreadConfig(const Wiimote::ThreadConfig & config) { mWiimoteManager.setWorkerThreadConfig(config); }
+
+	// Drain mode and worker stages of the app, shared with the soak test.
+	static void configureStages(Wiimote::Manager & manager);
+
 	void setup();
 	void update();
 	void draw();
 
 	void guiOscHostChanged(std::string & host);
 	void guiOscPortChanged(int & port);
+	void guiOscTcpChanged(bool & tcp);
+	void guiControlPortChanged(int & port);
+	void guiBinaryChanged(bool & enabled);
+	void guiBinaryPortChanged(int & port);
+	void guiShmChanged(bool & enabled);
+	void guiNodeIdChanged(int & node);
+	void guiAggregateChanged(bool & enabled);
+	void guiAggregatePortChanged(int & port);
 
 	void handleOscSetup();
+	void handleBinarySetup();
+	void handleAggregatorSetup();
+	void updateFrameSubscription();
+	void loadMapping();
+	void recordMotion();
 
 	void keyPressed(int key);
 	void keyReleased(int key);